@@ -4,11 +4,41 @@
 */
 
 #include <iostream>
+#include <string>
 
 #include "physics.hpp"
 
-int main()
+// Physics [--record <file> | --replay <file> | --barriers <file> | --read-trajectories <file>]
+int main(int argc, char* argv[])
 {
+	const std::string mode = (argc >= 3) ? argv[1] : "";
+
+	if (mode == "--read-trajectories")
+	{
+		size_t frames = 0, records = 0;
+		const bool ok = verify_trajectories(argv[2], frames, records);
+
+		std::cout << (ok ? "Read and re-encoded " : "Could not read or re-encode past ") << frames << " frames and "
+			<< records << " circle records from " << argv[2] << '\n';
+		return ok ? 0 : 1;
+	}
+
+	if (mode == "--replay")
+	{
+		Physics physics{ true };
+		return physics.replay(argv[2]) ? 0 : 1;
+	}
+
 	Physics physics{};
+
+	if (mode == "--record" && !physics.record_to(argv[2]))
+	{
+		std::cout << "Could not record to " << argv[2] << '\n';
+	}
+	else if (mode == "--barriers" && !physics.load_barriers_from(argv[2]))
+	{
+		std::cout << "Could not load barriers from " << argv[2] << '\n';
+	}
+
 	physics.run();
 }
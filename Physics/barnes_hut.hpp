@@ -0,0 +1,291 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <execution>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "detail.hpp"
+#include "utility.hpp"
+#include "circle.hpp"
+
+/*
+Mutual gravitation between circles, approximated with a Barnes-Hut quadtree. A circle's mass is
+proportional to its area.
+
+Each tick, circles are sorted by the Morton code of their position, so that every quadtree node covers
+a contiguous range of the sorted circles. The top levels are built serially; the subtrees below them,
+in parallel. Each circle then walks the tree, treating any node that looks smaller than `theta` (its
+width over its distance) as a single body at its center of mass.
+*/
+class barnes_hut_tree
+{
+public:
+	void build(const circle_store& circles)
+	{
+		const size_t count = circles.size();
+		nodes.clear();
+		if (count == 0) return;
+
+		// a square around every circle, so that each quadrant is square too
+		const auto [min_x, max_x] = std::minmax_element(circles.x.cbegin(), circles.x.cend());
+		const auto [min_y, max_y] = std::minmax_element(circles.y.cbegin(), circles.y.cend());
+		origin = { *min_x, *min_y };
+		size = std::max({ *max_x - *min_x, *max_y - *min_y, 1.f });
+
+		// sort by Morton code; the index breaks ties, so the order doesn't depend on the sort
+		keys.resize(count);
+		const float scale = 65535.f / size;
+		parallel_for(count, [&](const size_t i)
+		{
+			const uint32_t code = interleave(uint32_t((circles.x[i] - origin.x) * scale))
+				| (interleave(uint32_t((circles.y[i] - origin.y) * scale)) << 1);
+			keys[i] = (uint64_t(code) << 32) | i;
+		});
+		std::sort(std::execution::par, keys.begin(), keys.end());
+
+		codes.resize(count);
+		order.resize(count);
+		sorted_x.resize(count);
+		sorted_y.resize(count);
+		sorted_mass.resize(count);
+		parallel_for(count, [&](const size_t s)
+		{
+			const size_t i = uint32_t(keys[s]);
+			codes[s] = uint32_t(keys[s] >> 32);
+			order[s] = (uint32_t)i;
+			sorted_x[s] = circles.x[i];
+			sorted_y[s] = circles.y[i];
+			sorted_mass[s] = circles.radii[i] * circles.radii[i];
+		});
+
+		// the subtrees at split_depth, in parallel
+		const size_t subtree_count = size_t(1) << (2 * split_depth);
+		subtrees.resize(subtree_count);
+		std::vector<size_t> subtree_begin(subtree_count + 1, count);
+		for (size_t k = 0; k < subtree_count; ++k)
+		{
+			subtree_begin[k] = std::lower_bound(codes.cbegin(), codes.cend(), uint32_t(k << (32 - 2 * split_depth))) - codes.cbegin();
+		}
+
+		std::vector<size_t> subtree_ids(subtree_count);
+		std::iota(subtree_ids.begin(), subtree_ids.end(), size_t(0));
+		std::for_each(std::execution::par, subtree_ids.cbegin(), subtree_ids.cend(), [&](const size_t k)
+		{
+			subtrees[k].clear();
+			if (subtree_begin[k] < subtree_begin[k + 1]) build_node(subtrees[k], subtree_begin[k], subtree_begin[k + 1], split_depth);
+		});
+
+		// then the levels above them, splicing the subtrees in
+		build_top(0, count, 0);
+	}
+
+	// Adds every circle's acceleration toward every other circle
+	void apply(circle_store& circles, const float theta) const
+	{
+		if (nodes.empty()) return;
+
+		const float theta2 = theta * theta;
+		const float softening2 = detail::nbody_softening * detail::nbody_softening;
+
+		// in sorted order, so that neighboring circles walk the same parts of the tree
+		parallel_for(order.size(), [&](const size_t s)
+		{
+			const float px = sorted_x[s];
+			const float py = sorted_y[s];
+			float ax = 0.f;
+			float ay = 0.f;
+
+			const auto pull = [&](const float x, const float y, const float mass)
+			{
+				const float dx = x - px;
+				const float dy = y - py;
+				const float d2 = dx * dx + dy * dy + softening2;
+				const float f = mass / (d2 * sqrt(d2));
+				ax += dx * f;
+				ay += dy * f;
+			};
+
+			uint32_t stack[64 * 3];
+			size_t top = 0;
+			stack[top++] = 0;
+
+			while (top > 0)
+			{
+				const node& n = nodes[stack[--top]];
+
+				if (n.is_leaf())
+				{
+					for (uint32_t t = n.begin; t < n.end; ++t)
+					{
+						if (t != s) pull(sorted_x[t], sorted_y[t], sorted_mass[t]);
+					}
+					continue;
+				}
+
+				// a node holding this circle is always opened, or at a large theta the circle would pull on itself
+				const float dx = n.center_x - px;
+				const float dy = n.center_y - py;
+				const bool holds_this_circle = s >= n.begin && s < n.end;
+				if (!holds_this_circle && n.width * n.width < theta2 * (dx * dx + dy * dy))
+				{
+					pull(n.center_x, n.center_y, n.mass);
+					continue;
+				}
+
+				for (const int32_t child : n.children)
+				{
+					if (child >= 0) stack[top++] = (uint32_t)child;
+				}
+			}
+
+			circles.accelerate(order[s], { ax * detail::gravitational_constant, ay * detail::gravitational_constant });
+		}, 256);
+	}
+
+	size_t node_count() const { return nodes.size(); }
+
+private:
+	static constexpr int split_depth = 2; // the top levels are built serially, the 16 subtrees below them in parallel
+	static constexpr int max_depth = 16; // as deep as the Morton codes go
+	static constexpr uint32_t leaf_size = 8;
+
+	struct node
+	{
+		float mass = 0.f;
+		float center_x = 0.f; // of mass
+		float center_y = 0.f;
+		float width = 0.f;
+		int32_t children[4] = { -1, -1, -1, -1 };
+		uint32_t begin = 0; // the sorted circles under this node
+		uint32_t end = 0;
+
+		bool is_leaf() const { return children[0] < 0 && children[1] < 0 && children[2] < 0 && children[3] < 0; }
+	};
+
+	// spreads the low 16 bits out to the even bits
+	static uint32_t interleave(uint32_t v)
+	{
+		v &= 0xffff;
+		v = (v | (v << 8)) & 0x00ff00ff;
+		v = (v | (v << 4)) & 0x0f0f0f0f;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return v;
+	}
+
+	// the sorted range [begin, end) shares its top `depth` levels of code; split it by the next level
+	void split(const size_t begin, const size_t end, const int depth, size_t bounds[5]) const
+	{
+		const int shift = 32 - 2 * (depth + 1);
+		bounds[0] = begin;
+		for (uint32_t q = 1; q < 4; ++q)
+		{
+			bounds[q] = std::partition_point(codes.cbegin() + bounds[q - 1], codes.cbegin() + end,
+				[&](const uint32_t code) { return ((code >> shift) & 3) < q; }) - codes.cbegin();
+		}
+		bounds[4] = end;
+	}
+
+	int32_t build_node(std::vector<node>& out, const size_t begin, const size_t end, const int depth) const
+	{
+		const int32_t index = (int32_t)out.size();
+		out.emplace_back();
+		out[index].width = size / float(1 << depth);
+		out[index].begin = (uint32_t)begin;
+		out[index].end = (uint32_t)end;
+
+		if (end - begin <= leaf_size || depth == max_depth)
+		{
+			for (size_t s = begin; s < end; ++s)
+			{
+				out[index].mass += sorted_mass[s];
+				out[index].center_x += sorted_x[s] * sorted_mass[s];
+				out[index].center_y += sorted_y[s] * sorted_mass[s];
+			}
+		}
+		else
+		{
+			size_t bounds[5];
+			split(begin, end, depth, bounds);
+
+			for (size_t q = 0; q < 4; ++q)
+			{
+				if (bounds[q] == bounds[q + 1]) continue;
+
+				const int32_t child = build_node(out, bounds[q], bounds[q + 1], depth + 1);
+				out[index].children[q] = child;
+				out[index].mass += out[child].mass;
+				out[index].center_x += out[child].center_x * out[child].mass;
+				out[index].center_y += out[child].center_y * out[child].mass;
+			}
+		}
+
+		out[index].center_x /= out[index].mass;
+		out[index].center_y /= out[index].mass;
+		return index;
+	}
+
+	int32_t build_top(const size_t begin, const size_t end, const int depth)
+	{
+		if (depth == split_depth)
+		{
+			// move the subtree in, shifting its child indices along with it
+			const size_t k = codes[begin] >> (32 - 2 * split_depth);
+			const int32_t offset = (int32_t)nodes.size();
+			for (node n : subtrees[k])
+			{
+				for (int32_t& child : n.children)
+				{
+					if (child >= 0) child += offset;
+				}
+				nodes.push_back(n);
+			}
+			return offset;
+		}
+
+		if (end - begin <= leaf_size) return build_node(nodes, begin, end, depth);
+
+		const int32_t index = (int32_t)nodes.size();
+		nodes.emplace_back();
+
+		node n;
+		n.width = size / float(1 << depth);
+		n.begin = (uint32_t)begin;
+		n.end = (uint32_t)end;
+
+		size_t bounds[5];
+		split(begin, end, depth, bounds);
+
+		for (size_t q = 0; q < 4; ++q)
+		{
+			if (bounds[q] == bounds[q + 1]) continue;
+
+			const int32_t child = build_top(bounds[q], bounds[q + 1], depth + 1);
+			n.children[q] = child;
+			n.mass += nodes[child].mass;
+			n.center_x += nodes[child].center_x * nodes[child].mass;
+			n.center_y += nodes[child].center_y * nodes[child].mass;
+		}
+
+		n.center_x /= n.mass;
+		n.center_y /= n.mass;
+		nodes[index] = n;
+		return index;
+	}
+
+	sf::Vector2f origin;
+	float size = 1.f;
+
+	std::vector<uint64_t> keys; // Morton code, then circle index
+	std::vector<uint32_t> codes; // sorted
+	std::vector<uint32_t> order; // sorted position -> circle index
+	std::vector<float> sorted_x;
+	std::vector<float> sorted_y;
+	std::vector<float> sorted_mass;
+
+	std::vector<std::vector<node>> subtrees;
+	std::vector<node> nodes; // the root is first
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+
 #define _USE_MATH_DEFINES
 #include <math.h>
 
@@ -8,83 +10,105 @@
 #include "detail.hpp"
 #include "utility.hpp"
 
+// A capsule: a segment from a to b, with rounded ends. Barriers hold no shapes of their own; they are
+// drawn with shapes shared by every barrier.
 class barrier
 {
 public:
-	barrier()
+	barrier() = default;
+	barrier(const sf::Vector2f a, const sf::Vector2f b, const float set_thickness = detail::barrier_thickness)
+		: thickness(set_thickness)
 	{
-		const auto half_barrier_thickness = detail::barrier_thickness / 2.f;
-
-		middle_part.setOrigin({ 0.f, half_barrier_thickness });
-		middle_part.setFillColor(detail::new_barrier_color);
-
-		end_1.setRadius(half_barrier_thickness);
-		end_1.setOrigin(half_barrier_thickness, half_barrier_thickness);
-		end_1.setFillColor(detail::barrier_endcap_color);
-
-		end_2.setRadius(half_barrier_thickness);
-		end_2.setOrigin(half_barrier_thickness, half_barrier_thickness);
-		end_2.setFillColor(detail::barrier_endcap_color);
+		set_position(a, b);
 	}
 
-	void set_position(sf::Vector2f& a, sf::Vector2f& b)
+	void set_position(const sf::Vector2f a, const sf::Vector2f b)
 	{
-		const auto distance = distance_between(a, b);
-
-		middle_part.setSize({ distance, detail::barrier_thickness });
-		middle_part.setPosition(a);
-		middle_part.setRotation(atan2(b.y - a.y, b.x - a.x) * 180.f / (float)M_PI);
-
-		const auto t = middle_part.getTransform();
-
-		end_1.setPosition(t.transformPoint(0.f, detail::barrier_thickness / 2.f));
-		end_2.setPosition(t.transformPoint(distance, detail::barrier_thickness / 2.f));
-	}
-	const sf::Vector2f get_size() const
-	{
-		return middle_part.getSize();
+		point_a = a;
+		point_b = b;
+		length = distance_between(a, b);
+
+		// the two long sides are offset from the segment by half the thickness
+		const sf::Vector2f offset = (length > 0.f)
+			? sf::Vector2f{ a.y - b.y, b.x - a.x } * (get_radius() / length)
+			: sf::Vector2f{ 0.f, 0.f };
+
+		// A B
+		// C D
+		corners = { a - offset, b - offset, a + offset, b + offset };
 	}
 
-	const sf::Transform& get_transform() const
+	bool is_mouse_over(const sf::Vector2f mouse_pos) const
 	{
-		return middle_part.getTransform();
+		return is_crossed_by(mouse_pos, mouse_pos);
 	}
 
-	void draw(sf::RenderWindow& window)
+	// True if the segment from p to q touches the rectangle between the end caps
+	bool is_crossed_by(const sf::Vector2f p, const sf::Vector2f q) const
 	{
-		window.draw(middle_part);
-
-		window.draw(end_1);
-		window.draw(end_2);
-	}
-
-	bool is_mouse_over(sf::Vector2f& mouse_pos) const
-	{
-		return is_point_in_rectangle(mouse_pos, middle_part);
+		if (length == 0.f) return false;
+
+		// p and q in the barrier's frame: how far along the barrier, and how far to one side
+		const sf::Vector2f u = (point_b - point_a) / length;
+		const sf::Vector2f ap = p - point_a;
+		const sf::Vector2f aq = q - point_a;
+		const float along = dot(ap, u);
+		const float side = ap.x * u.y - ap.y * u.x;
+		const float along_delta = dot(aq, u) - along;
+		const float side_delta = (aq.x * u.y - aq.y * u.x) - side;
+
+		// clip the segment to the rectangle, one axis at a time
+		float t_begin = 0.f;
+		float t_end = 1.f;
+		const auto clip = [&](const float start, const float delta, const float low, const float high)
+		{
+			if (delta == 0.f) return start >= low && start <= high;
+
+			const float t_low = (low - start) / delta;
+			const float t_high = (high - start) / delta;
+			t_begin = std::max(t_begin, std::min(t_low, t_high));
+			t_end = std::min(t_end, std::max(t_low, t_high));
+			return t_begin <= t_end;
+		};
+
+		return clip(along, along_delta, 0.f, length) && clip(side, side_delta, -get_radius(), get_radius());
 	}
 
 	void set_to_default_color()
 	{
-		middle_part.setFillColor(detail::barrier_color);
+		color = detail::barrier_color;
 	}
 
 	bool has_valid_length() const
 	{
-		return middle_part.getSize().x >= detail::min_barrier_length;
+		return length >= detail::min_barrier_length;
 	}
 
 	void reset()
 	{
-		middle_part.setSize({ 0.f, 0.f });
-		middle_part.setPosition({ -1.f, -1.f });
+		set_position({ -1.f, -1.f }, { -1.f, -1.f });
 	}
 
-	const sf::CircleShape& get_end_1() const { return end_1; }
-	const sf::CircleShape& get_end_2() const { return end_2; }
+	sf::Vector2f get_a() const { return point_a; }
+	sf::Vector2f get_b() const { return point_b; }
+	float get_length() const { return length; }
+	float get_thickness() const { return thickness; }
+	float get_radius() const { return thickness / 2.f; }
+	sf::Color get_color() const { return color; }
+
+	// the corners of the rectangle between the end caps: A and B along one side, C and D along the other
+	const std::array<sf::Vector2f, 4>& get_corners() const { return corners; }
+
+	// the bounding box, including the end caps
+	sf::Vector2f get_min() const { return { std::min(point_a.x, point_b.x) - get_radius(), std::min(point_a.y, point_b.y) - get_radius() }; }
+	sf::Vector2f get_max() const { return { std::max(point_a.x, point_b.x) + get_radius(), std::max(point_a.y, point_b.y) + get_radius() }; }
 
 private:
-	sf::RectangleShape middle_part; // for lack of a better name
+	sf::Vector2f point_a{ -1.f, -1.f };
+	sf::Vector2f point_b{ -1.f, -1.f };
+	float length = 0.f;
+	float thickness = detail::barrier_thickness;
+	sf::Color color = detail::new_barrier_color;
 
-	sf::CircleShape end_1;
-	sf::CircleShape end_2;
+	std::array<sf::Vector2f, 4> corners;
 };
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "detail.hpp"
+#include "barrier.hpp"
+
+// A uniform grid over the bounding box of all barriers, built once whenever barriers are added.
+// Each barrier is listed in every cell its bounding box touches; the lists are stored back to back.
+// Barriers can be removed without a rebuild, see swap_remove().
+class barrier_grid
+{
+public:
+	void build(const std::vector<barrier>& barriers)
+	{
+		sf::Vector2f min{ 0.f, 0.f };
+		sf::Vector2f max{ 0.f, 0.f };
+		thinnest = barriers.empty() ? 0.f : barriers.front().get_thickness();
+
+		for (size_t i = 0; i < barriers.size(); ++i)
+		{
+			const sf::Vector2f b_min = barriers[i].get_min();
+			const sf::Vector2f b_max = barriers[i].get_max();
+			min = (i == 0) ? b_min : sf::Vector2f{ std::min(min.x, b_min.x), std::min(min.y, b_min.y) };
+			max = (i == 0) ? b_max : sf::Vector2f{ std::max(max.x, b_max.x), std::max(max.y, b_max.y) };
+			thinnest = std::min(thinnest, barriers[i].get_thickness());
+		}
+
+		// aim for a few barriers per cell, if they were spread evenly
+		origin = min;
+		const float area = std::max((max.x - min.x) * (max.y - min.y), 1.f);
+		cell_size = std::max(2.f * std::sqrt(area / std::max(barriers.size(), size_t(1))), 1.f);
+		cols = (int)std::min((max.x - min.x) / cell_size + 1.f, detail::grid_max_cells_per_axis);
+		rows = (int)std::min((max.y - min.y) / cell_size + 1.f, detail::grid_max_cells_per_axis);
+
+		// count, scan, then fill, in barrier order
+		ranges.resize(barriers.size());
+		cell_start.assign((size_t)cols * rows + 1, 0);
+
+		for (size_t i = 0; i < barriers.size(); ++i)
+		{
+			ranges[i] = range_of(barriers[i].get_min(), barriers[i].get_max());
+			for_each_cell(ranges[i], [&](const size_t cell) { ++cell_start[cell + 1]; });
+		}
+
+		std::partial_sum(cell_start.begin(), cell_start.end(), cell_start.begin());
+		items.resize(cell_start.back());
+
+		cell_count.assign((size_t)cols * rows, 0);
+		for (size_t i = 0; i < barriers.size(); ++i)
+		{
+			for_each_cell(ranges[i], [&](const size_t cell) { items[cell_start[cell] + cell_count[cell]++] = (uint32_t)i; });
+		}
+	}
+
+	// Call just before erasing barrier k by moving the last barrier into its place.
+	// Costs a few cells' worth of work, not a rebuild.
+	void swap_remove(const size_t k)
+	{
+		const size_t last = ranges.size() - 1;
+
+		for_each_cell(ranges[k], [&](const size_t cell)
+		{
+			uint32_t* const begin = items.data() + cell_start[cell];
+			uint32_t* const end = begin + cell_count[cell];
+			*std::find(begin, end, (uint32_t)k) = *(end - 1);
+			--cell_count[cell];
+		});
+
+		if (k != last)
+		{
+			for_each_cell(ranges[last], [&](const size_t cell)
+			{
+				uint32_t* const begin = items.data() + cell_start[cell];
+				*std::find(begin, begin + cell_count[cell], (uint32_t)last) = (uint32_t)k;
+			});
+
+			ranges[k] = ranges[last];
+		}
+
+		ranges.pop_back();
+	}
+
+	// Calls f(index) once for every barrier whose bounding box shares a cell with the given box.
+	// Barriers are not distance-checked; the caller is expected to do that.
+	template<typename F>
+	void for_each_near(const sf::Vector2f min, const sf::Vector2f max, F f) const
+	{
+		if (items.empty()) return;
+
+		const cell_range query = range_of(min, max);
+
+		for (int row = query.row_begin; row <= query.row_end; ++row)
+		{
+			for (int col = query.col_begin; col <= query.col_end; ++col)
+			{
+				const size_t cell = (size_t)row * cols + col;
+				for (uint32_t k = cell_start[cell]; k < cell_start[cell] + cell_count[cell]; ++k)
+				{
+					// a barrier spanning several cells is only visited in the first cell it shares with the query
+					const cell_range& r = ranges[items[k]];
+					if (col == std::max(query.col_begin, r.col_begin) && row == std::max(query.row_begin, r.row_begin))
+					{
+						f((size_t)items[k]);
+					}
+				}
+			}
+		}
+	}
+
+	// the thickness of the thinnest barrier since the last build, or 0 if there were none
+	float min_thickness() const { return thinnest; }
+
+private:
+	struct cell_range
+	{
+		int col_begin;
+		int col_end;
+		int row_begin;
+		int row_end;
+	};
+
+	cell_range range_of(const sf::Vector2f min, const sf::Vector2f max) const
+	{
+		return { col_of(min.x), col_of(max.x), row_of(min.y), row_of(max.y) };
+	}
+
+	template<typename F>
+	void for_each_cell(const cell_range& r, F f) const
+	{
+		for (int row = r.row_begin; row <= r.row_end; ++row)
+		{
+			for (int col = r.col_begin; col <= r.col_end; ++col)
+			{
+				f((size_t)row * cols + col);
+			}
+		}
+	}
+
+	// positions outside the grid are clamped into the border cells
+	int col_of(const float x) const { return (int)std::clamp((x - origin.x) / cell_size, 0.f, float(cols - 1)); }
+	int row_of(const float y) const { return (int)std::clamp((y - origin.y) / cell_size, 0.f, float(rows - 1)); }
+
+	sf::Vector2f origin;
+	float cell_size = 1.f;
+	float thinnest = 0.f;
+	int cols = 1;
+	int rows = 1;
+
+	std::vector<cell_range> ranges; // per barrier
+	std::vector<uint32_t> cell_start{ 0, 0 };
+	std::vector<uint32_t> cell_count{ 0 }; // cells shrink as barriers are removed
+	std::vector<uint32_t> items;
+};
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "detail.hpp"
+#include "utility.hpp"
+#include "barrier.hpp"
+#include "mapped_file.hpp"
+
+/*
+Barrier layouts are stored as text or as binary; loading tells them apart by the binary magic.
+
+Text: one barrier per line, as "ax ay bx by [thickness]", separated by spaces or tabs. The thickness
+defaults to detail::barrier_thickness. Blank lines and lines starting with '#' are skipped.
+
+Either way, a layout with a non-finite coordinate or a thickness that is not positive is rejected.
+
+Binary: a header (magic, version, barrier count), then five floats per barrier: ax, ay, bx, by, thickness.
+*/
+enum class layout_format { text, binary };
+
+namespace barrier_layout
+{
+	const char magic[8] = { 'P', 'H', 'Y', 'S', 'B', 'A', 'R', 'R' };
+	const uint32_t version = 1;
+
+	struct header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t unused;
+		uint64_t barrier_count;
+	};
+
+	struct record
+	{
+		float ax, ay, bx, by, thickness;
+	};
+
+	// Anything else would reach the barrier grid's cell sizing and the capsule math
+	bool is_valid(const record& r)
+	{
+		return std::isfinite(r.ax) && std::isfinite(r.ay) && std::isfinite(r.bx) && std::isfinite(r.by)
+			&& std::isfinite(r.thickness) && r.thickness > 0.f;
+	}
+
+	bool is_blank(const char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+	const char* skip_blanks(const char* p, const char* end)
+	{
+		while (p != end && is_blank(*p)) ++p;
+		return p;
+	}
+
+	bool load_text(std::vector<barrier>& barriers, const char* p, const char* const end)
+	{
+		barriers.reserve(std::count(p, end, '\n') + 1);
+
+		while (p != end)
+		{
+			p = skip_blanks(p, end);
+
+			if (p != end && *p == '#')
+			{
+				p = std::find(p, end, '\n');
+			}
+			else if (p != end && *p != '\n')
+			{
+				record r{ 0.f, 0.f, 0.f, 0.f, detail::barrier_thickness };
+				float* const values[5] = { &r.ax, &r.ay, &r.bx, &r.by, &r.thickness };
+
+				for (int i = 0; i < 5; ++i)
+				{
+					p = skip_blanks(p, end);
+					if (i == 4 && (p == end || *p == '\n')) break; // the thickness is optional
+
+					const auto [next, error] = std::from_chars(p, end, *values[i]);
+					if (error != std::errc{}) return false;
+					p = next;
+				}
+
+				p = skip_blanks(p, end);
+				if ((p != end && *p != '\n') || !is_valid(r)) return false;
+
+				barriers.emplace_back(sf::Vector2f{ r.ax, r.ay }, sf::Vector2f{ r.bx, r.by }, r.thickness);
+			}
+
+			if (p != end) ++p; // the newline
+		}
+
+		return true;
+	}
+
+	bool load_binary(std::vector<barrier>& barriers, const uint8_t* const data, const size_t size)
+	{
+		header h;
+		std::memcpy(&h, data, sizeof(h));
+
+		if (h.version != version || (size - sizeof(h)) / sizeof(record) < h.barrier_count) return false;
+
+		const uint8_t* const records = data + sizeof(h);
+		barriers.resize((size_t)h.barrier_count);
+
+		std::atomic<bool> valid{ true };
+		parallel_for(barriers.size(), [&](const size_t i)
+		{
+			record r;
+			std::memcpy(&r, records + i * sizeof(record), sizeof(r));
+			if (!is_valid(r)) valid = false;
+			else barriers[i] = barrier{ { r.ax, r.ay }, { r.bx, r.by }, r.thickness };
+		});
+
+		return valid;
+	}
+}
+
+// Replaces `barriers` with the layout in the file. On failure, `barriers` is left as it was.
+bool load_barriers(std::vector<barrier>& barriers, const std::string& path)
+{
+	using namespace barrier_layout;
+
+	const mapped_file file{ path };
+	if (!file.is_open()) return false;
+
+	std::vector<barrier> loaded;
+	const bool is_binary = file.size() >= sizeof(header) && std::memcmp(file.data(), magic, sizeof(magic)) == 0;
+	const bool ok = is_binary
+		? load_binary(loaded, file.data(), file.size())
+		: load_text(loaded, (const char*)file.data(), (const char*)file.data() + file.size());
+
+	if (!ok) return false;
+
+	for (auto& barrier : loaded)
+	{
+		barrier.set_to_default_color();
+	}
+
+	barriers.swap(loaded);
+	return true;
+}
+
+bool save_barriers(const std::vector<barrier>& barriers, const std::string& path, const layout_format format)
+{
+	using namespace barrier_layout;
+
+	std::vector<char> out;
+
+	if (format == layout_format::binary)
+	{
+		header h{};
+		std::memcpy(h.magic, magic, sizeof(h.magic));
+		h.version = version;
+		h.barrier_count = barriers.size();
+
+		out.resize(sizeof(h) + barriers.size() * sizeof(record));
+		std::memcpy(out.data(), &h, sizeof(h));
+
+		for (size_t i = 0; i < barriers.size(); ++i)
+		{
+			const barrier& b = barriers[i];
+			const record r{ b.get_a().x, b.get_a().y, b.get_b().x, b.get_b().y, b.get_thickness() };
+			std::memcpy(out.data() + sizeof(h) + i * sizeof(record), &r, sizeof(r));
+		}
+	}
+	else
+	{
+		// the shortest text that reads back as the same float
+		char line[5 * 16];
+		for (const auto& b : barriers)
+		{
+			const float values[5] = { b.get_a().x, b.get_a().y, b.get_b().x, b.get_b().y, b.get_thickness() };
+
+			char* p = line;
+			for (int i = 0; i < 5; ++i)
+			{
+				p = std::to_chars(p, line + sizeof(line), values[i]).ptr;
+				*p++ = (i < 4) ? ' ' : '\n';
+			}
+
+			out.insert(out.end(), line, p);
+		}
+	}
+
+	std::FILE* file = std::fopen(path.c_str(), "wb");
+	if (file == nullptr) return false;
+
+	const bool ok = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+	return std::fclose(file) == 0 && ok;
+}
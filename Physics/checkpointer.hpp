@@ -0,0 +1,126 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#include "utility.hpp"
+#include "snapshot.hpp"
+
+/*
+Writes periodic checkpoints without stalling the tick loop. The tick thread copies the world into a
+spare world_state (one copy per array, into memory reused from earlier checkpoints), then hands it over;
+a background thread serializes it and flushes it to disk. While a checkpoint is still being written,
+new ones are skipped.
+
+Checkpoints are written to a temporary file and then moved over the previous one in a single step, so
+a crash at any point leaves either the previous checkpoint or the new one, never a torn one or none.
+*/
+class checkpointer
+{
+public:
+	explicit checkpointer(const std::string& set_path) : path(set_path)
+	{
+		writer = std::thread{ [this] { write_checkpoints(); } };
+	}
+
+	~checkpointer()
+	{
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			stopping = true;
+		}
+		wake.notify_one();
+		writer.join();
+	}
+
+	bool is_busy()
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		return pending;
+	}
+
+	// Call at a tick boundary. Returns false if the previous checkpoint was still being written.
+	template<typename F>
+	bool capture(F copy_world_into)
+	{
+		if (is_busy()) return false;
+
+		// the writer is idle, so `spare` is ours until we set `pending`
+		copy_world_into(spare);
+
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			pending = true;
+		}
+		wake.notify_one();
+		return true;
+	}
+
+	// Set by the writer thread; read these only while not busy
+	bool last_write_ok = true;
+	float last_write_ms = 0.f;
+	size_t checkpoints_written = 0;
+
+private:
+	void write_checkpoints()
+	{
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock{ mutex };
+				wake.wait(lock, [&] { return stopping || pending; });
+				if (!pending) return;
+			}
+
+			const auto start = current_time_in_us();
+
+			const std::string temporary_path = path + ".tmp";
+
+			const bool ok = save_snapshot(spare, temporary_path, true) && replace_file(temporary_path, path);
+
+			last_write_ok = ok;
+			last_write_ms = (current_time_in_us() - start) / 1000.f;
+			if (ok) ++checkpoints_written;
+
+			{
+				std::lock_guard<std::mutex> lock{ mutex };
+				pending = false;
+			}
+		}
+	}
+
+	// Moves `from` over `to` in one step, so that there is always a checkpoint on disk
+	static bool replace_file(const std::string& from, const std::string& to)
+	{
+#ifdef _WIN32
+		const auto widen = [](const std::string& s)
+		{
+			std::wstring wide(MultiByteToWideChar(CP_UTF8, 0, s.c_str(), -1, nullptr, 0), L'\0');
+			MultiByteToWideChar(CP_UTF8, 0, s.c_str(), -1, wide.data(), (int)wide.size());
+			return wide;
+		};
+		return MoveFileExW(widen(from).c_str(), widen(to).c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+		// rename replaces an existing file atomically
+		return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+	}
+
+	const std::string path;
+	world_state spare;
+
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+	bool pending = false;
+};
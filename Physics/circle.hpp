@@ -1,42 +1,241 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <xmmintrin.h>
+
 #include <SFML/Graphics.hpp>
 
-class circle
+// Refers to one circle for as long as it exists, no matter how the store is reordered
+struct circle_handle
+{
+	uint32_t slot = UINT32_MAX;
+	uint32_t generation = 0;
+};
+
+// Every circle, stored as parallel arrays so that per-circle passes stream through memory.
+// Circles are removed by marking them, then compacting all arrays in one pass.
+class circle_store
 {
 public:
-	circle(const sf::CircleShape& set_sf_circle) : sf_circle(set_sf_circle)
+	size_t size() const { return x.size(); }
+	bool empty() const { return x.empty(); }
+
+	circle_handle add(const sf::Vector2f position, const float radius, const sf::Color color)
 	{
-		previous_position = sf_circle.getPosition();
+		const uint32_t slot = allocate_slot(size());
+		slots.push_back(slot);
+		removed.push_back(uint8_t(false));
+
+		x.push_back(position.x);
+		y.push_back(position.y);
+		previous_x.push_back(position.x);
+		previous_y.push_back(position.y);
+		acceleration_x.push_back(0.f);
+		acceleration_y.push_back(0.f);
+		radii.push_back(radius);
+		colors.push_back(color);
+
+		return { slot, generations[slot] };
 	}
 
-	// call for each effect
-	void accelerate(const sf::Vector2f update) { acceleration += update; }
+	// Appends `count` circles at rest at the origin, for the caller to fill in (in parallel, if it likes).
+	// Returns the index of the first one.
+	size_t grow(const size_t count)
+	{
+		const size_t first = size();
+		resize(first + count);
+
+		for (size_t i = first; i < size(); ++i)
+		{
+			slots[i] = allocate_slot(i);
+		}
 
-	void reset_velocity() { previous_position = sf_circle.getPosition(); }
+		return first;
+	}
 
-	// call once per time step
-	void update_position(const float dt)
+	// The circle stays in place until the next call to compact(). Safe to call from parallel passes.
+	void remove(const size_t i)
 	{
-		const auto pos = sf_circle.getPosition();
-		const auto velocity = pos - previous_position;
+		removed[i] = true;
+	}
+
+	// Drops every removed circle in one linear pass. Remaining circles keep their relative order.
+	void compact()
+	{
+		if (std::find(removed.cbegin(), removed.cend(), uint8_t(true)) == removed.cend()) return;
+
+		size_t write = 0;
+		for (size_t read = 0; read < size(); ++read)
+		{
+			const uint32_t slot = slots[read];
+
+			if (removed[read])
+			{
+				++generations[slot]; // invalidate any outstanding handles
+				free_slots.push_back(slot);
+				continue;
+			}
+
+			if (write != read)
+			{
+				x[write] = x[read];
+				y[write] = y[read];
+				previous_x[write] = previous_x[read];
+				previous_y[write] = previous_y[read];
+				acceleration_x[write] = acceleration_x[read];
+				acceleration_y[write] = acceleration_y[read];
+				radii[write] = radii[read];
+				colors[write] = colors[read];
+				slots[write] = slot;
+			}
 
-		previous_position = pos;
+			slot_to_index[slot] = (uint32_t)write;
+			++write;
+		}
+
+		resize(write);
+		std::fill(removed.begin(), removed.end(), uint8_t(false));
+	}
+
+	bool is_valid(const circle_handle handle) const
+	{
+		return handle.slot < generations.size() && generations[handle.slot] == handle.generation;
+	}
 
-		// apply velocity and acceleration
-		sf_circle.setPosition(sf_circle.getPosition() + velocity + acceleration * dt * dt);
+	// only valid until the next call to compact()
+	size_t index_of(const circle_handle handle) const { return slot_to_index[handle.slot]; }
+	circle_handle handle_of(const size_t i) const { return { slots[i], generations[slots[i]] }; }
 
-		// reset
-		acceleration = sf::Vector2f();
+	// keeps the slot generations, so that old handles stay invalid
+	void clear()
+	{
+		std::fill(removed.begin(), removed.end(), uint8_t(true));
+		compact();
 	}
 
-	sf::Vector2f position() const { return sf_circle.getPosition(); }
-	float radius() const { return sf_circle.getRadius(); }
+	bool is_removed(const size_t i) const { return removed[i]; }
+
+	sf::Vector2f position(const size_t i) const { return { x[i], y[i] }; }
+	void set_position(const size_t i, const sf::Vector2f position) { x[i] = position.x; y[i] = position.y; }
+	void move(const size_t i, const sf::Vector2f offset) { x[i] += offset.x; y[i] += offset.y; }
+
+	float radius(const size_t i) const { return radii[i]; }
+
+	// call for each effect
+	void accelerate(const size_t i, const sf::Vector2f update) { acceleration_x[i] += update.x; acceleration_y[i] += update.y; }
+
+	void reset_velocity(const size_t i) { previous_x[i] = x[i]; previous_y[i] = y[i]; }
+
+	// velocity is per time step, i.e. how far the circle moved during the last update
+	sf::Vector2f velocity(const size_t i) const { return { x[i] - previous_x[i], y[i] - previous_y[i] }; }
+	void set_velocity(const size_t i, const sf::Vector2f velocity) { previous_x[i] = x[i] - velocity.x; previous_y[i] = y[i] - velocity.y; }
+
+	// Call once per time step. Applies the uniform acceleration and each circle's accumulated acceleration,
+	// integrates, and resets the accumulators, all in one pass, four circles at a time.
+	void update_positions(const sf::Vector2f uniform_acceleration, const float dt)
+	{
+		const size_t count = size();
+		const float dt2 = dt * dt;
+		const float uniform_x = uniform_acceleration.x * dt2;
+		const float uniform_y = uniform_acceleration.y * dt2;
+
+		float* const px = x.data();
+		float* const py = y.data();
+		float* const ox = previous_x.data();
+		float* const oy = previous_y.data();
+		float* const ax = acceleration_x.data();
+		float* const ay = acceleration_y.data();
+
+		const __m128 dt2_4 = _mm_set1_ps(dt2);
+		const __m128 uniform_x_4 = _mm_set1_ps(uniform_x);
+		const __m128 uniform_y_4 = _mm_set1_ps(uniform_y);
+		const __m128 zero = _mm_setzero_ps();
+
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			// position + velocity + acceleration * dt * dt, where velocity = position - previous position
+			const __m128 pos_x = _mm_loadu_ps(px + i);
+			const __m128 pos_y = _mm_loadu_ps(py + i);
+			const __m128 vel_x = _mm_sub_ps(pos_x, _mm_loadu_ps(ox + i));
+			const __m128 vel_y = _mm_sub_ps(pos_y, _mm_loadu_ps(oy + i));
+			const __m128 acc_x = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(ax + i), dt2_4), uniform_x_4);
+			const __m128 acc_y = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(ay + i), dt2_4), uniform_y_4);
 
-	sf::CircleShape sf_circle;
+			_mm_storeu_ps(ox + i, pos_x);
+			_mm_storeu_ps(oy + i, pos_y);
+			_mm_storeu_ps(px + i, _mm_add_ps(_mm_add_ps(pos_x, vel_x), acc_x));
+			_mm_storeu_ps(py + i, _mm_add_ps(_mm_add_ps(pos_y, vel_y), acc_y));
+			_mm_storeu_ps(ax + i, zero);
+			_mm_storeu_ps(ay + i, zero);
+		}
+
+		// the remaining zero to three circles, with the same operations in the same order
+		for (; i < count; ++i)
+		{
+			const float vel_x = px[i] - ox[i];
+			const float vel_y = py[i] - oy[i];
+
+			ox[i] = px[i];
+			oy[i] = py[i];
+			px[i] = (px[i] + vel_x) + (ax[i] * dt2 + uniform_x);
+			py[i] = (py[i] + vel_y) + (ay[i] * dt2 + uniform_y);
+			ax[i] = 0.f;
+			ay[i] = 0.f;
+		}
+	}
+
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> previous_x;
+	std::vector<float> previous_y;
+	std::vector<float> acceleration_x;
+	std::vector<float> acceleration_y;
+	std::vector<float> radii;
+	std::vector<sf::Color> colors;
 
 private:
+	// reuses a free slot if there is one, and points it at the given index
+	uint32_t allocate_slot(const size_t index)
+	{
+		uint32_t slot;
+		if (free_slots.empty())
+		{
+			slot = (uint32_t)slot_to_index.size();
+			slot_to_index.push_back(0);
+			generations.push_back(0);
+		}
+		else
+		{
+			slot = free_slots.back();
+			free_slots.pop_back();
+		}
+
+		slot_to_index[slot] = (uint32_t)index;
+		return slot;
+	}
+
+	void resize(const size_t count)
+	{
+		x.resize(count);
+		y.resize(count);
+		previous_x.resize(count);
+		previous_y.resize(count);
+		acceleration_x.resize(count);
+		acceleration_y.resize(count);
+		radii.resize(count);
+		colors.resize(count);
+		slots.resize(count);
+		removed.resize(count);
+	}
+
+	std::vector<uint32_t> slots; // index -> slot
+	std::vector<uint8_t> removed; // not vector<bool>, so that circles can be removed from parallel passes
 
-	sf::Vector2f previous_position;
-	sf::Vector2f acceleration;
+	std::vector<uint32_t> slot_to_index;
+	std::vector<uint32_t> generations;
+	std::vector<uint32_t> free_slots;
 };
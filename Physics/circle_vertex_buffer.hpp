@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "detail.hpp"
+#include "utility.hpp"
+#include "circle.hpp"
+
+/*
+The visible circles as textured quads in a vertex buffer that lives on the GPU from frame to frame. Each
+circle's quad sits at its slot in the circle store, which stays the same for as long as the circle
+exists, so circles coming into view, leaving it, or being added elsewhere don't move anyone else's quad.
+Slots whose circles are out of view hold an empty quad, which costs the GPU a few vertices and no pixels.
+
+A copy of the uploaded vertices is kept on the CPU; each frame, only the quads that differ from that
+copy are uploaded, in as few ranges as possible. Circles at rest in a still view cost nothing to
+upload, and nothing off screen is built or uploaded.
+*/
+class circle_vertex_buffer : public sf::Drawable
+{
+public:
+	circle_vertex_buffer() : buffer(sf::Quads, sf::VertexBuffer::Stream) {}
+
+	void update(const circle_store& circles, const std::vector<uint32_t>& visible)
+	{
+		// created on first use, so that a headless Physics never needs a graphics context
+		if (disc.getSize().x == 0) make_disc();
+
+		slots.resize(visible.size());
+		size_t top = 0; // one past the highest slot in view
+		for (size_t k = 0; k < visible.size(); ++k)
+		{
+			slots[k] = circles.handle_of(visible[k]).slot;
+			top = std::max(top, size_t(slots[k]) + 1);
+		}
+
+		// a new buffer starts out undefined, so all of it is uploaded, empty quads included
+		bool upload_all = false;
+		if (top > capacity)
+		{
+			capacity = std::max({ top, capacity * 2, size_t(1024) });
+			buffer.create(capacity * 4);
+			uploaded.resize(capacity * 4);
+			in_view.resize(capacity);
+			upload_all = true;
+		}
+
+		changed.resize(visible.size());
+		const float size = (float)disc.getSize().x;
+		parallel_for(visible.size(), [&](const size_t k)
+		{
+			const size_t i = visible[k];
+			const float r = circles.radii[i];
+			const sf::Color color = circles.colors[i];
+			const sf::Vertex quad[4] = {
+				{ { circles.x[i] - r, circles.y[i] - r }, color, { 0.f, 0.f } },
+				{ { circles.x[i] + r, circles.y[i] - r }, color, { size, 0.f } },
+				{ { circles.x[i] + r, circles.y[i] + r }, color, { size, size } },
+				{ { circles.x[i] - r, circles.y[i] + r }, color, { 0.f, size } } };
+
+			sf::Vertex* const at = &uploaded[size_t(slots[k]) * 4];
+			changed[k] = std::memcmp(quad, at, sizeof(quad)) != 0;
+			if (changed[k]) std::memcpy(at, quad, sizeof(quad));
+		}, 4096);
+
+		changed_slots.clear();
+		for (size_t k = 0; k < visible.size(); ++k)
+		{
+			in_view[slots[k]] = 1;
+			if (changed[k]) changed_slots.push_back(slots[k]);
+		}
+
+		// the quads of circles that were in view last frame and aren't now are emptied, even past `top`,
+		// since a later frame may draw that far
+		for (const uint32_t slot : shown_slots)
+		{
+			if (in_view[slot]) continue;
+
+			std::fill_n(&uploaded[size_t(slot) * 4], 4, sf::Vertex{});
+			changed_slots.push_back(slot);
+		}
+		for (const uint32_t slot : slots) in_view[slot] = 0;
+		shown_slots.assign(slots.cbegin(), slots.cend());
+
+		std::sort(changed_slots.begin(), changed_slots.end());
+		if (upload_all)
+		{
+			buffer.update(uploaded.data(), capacity * 4, 0);
+			changed_slots.clear();
+		}
+
+		// changed quads separated by a short enough run of unchanged ones are uploaded together
+		uploaded_circles = upload_all ? capacity : 0;
+		upload_ranges = upload_all ? 1 : 0;
+		for (size_t c = 0; c < changed_slots.size(); )
+		{
+			const size_t begin = changed_slots[c];
+			size_t end = begin + 1;
+			for (++c; c < changed_slots.size() && changed_slots[c] < end + detail::vertex_upload_gap; ++c)
+			{
+				end = size_t(changed_slots[c]) + 1;
+			}
+
+			buffer.update(&uploaded[begin * 4], (end - begin) * 4, (unsigned)(begin * 4));
+			uploaded_circles += end - begin;
+			++upload_ranges;
+		}
+
+		shown_circles = visible.size();
+		drawn = top;
+	}
+
+	size_t shown_circles = 0; // in the last update
+	size_t uploaded_circles = 0; // including the empty quads of circles that left the view
+	size_t upload_ranges = 0;
+
+private:
+	void draw(sf::RenderTarget& target, sf::RenderStates states) const override
+	{
+		if (drawn == 0) return;
+
+		states.texture = &disc;
+		target.draw(buffer, 0, drawn * 4, states);
+	}
+
+	// a white disc with a soft edge; each quad tints it with its circle's color
+	void make_disc()
+	{
+		const unsigned size = 64;
+		sf::Image image;
+		image.create(size, size, sf::Color::Transparent);
+
+		for (unsigned y = 0; y < size; ++y)
+		{
+			for (unsigned x = 0; x < size; ++x)
+			{
+				const float dx = x + .5f - size / 2.f;
+				const float dy = y + .5f - size / 2.f;
+				const float coverage = std::min(std::max(size / 2.f - sqrt(dx * dx + dy * dy), 0.f), 1.f);
+				image.setPixel(x, y, { 255, 255, 255, uint8_t(coverage * 255.f) });
+			}
+		}
+
+		disc.loadFromImage(image);
+		disc.setSmooth(true);
+	}
+
+	sf::VertexBuffer buffer;
+	sf::Texture disc;
+	size_t capacity = 0; // in quads
+	size_t drawn = 0; // quads, counting the empty ones among them
+
+	std::vector<sf::Vertex> uploaded; // what the GPU holds, per slot
+	std::vector<uint32_t> slots; // of the visible circles, this update
+	std::vector<uint8_t> changed; // per visible circle, this update
+	std::vector<uint32_t> changed_slots;
+	std::vector<uint32_t> shown_slots; // the visible circles' slots, as of the last update
+	std::vector<uint8_t> in_view; // per slot; only set while an update runs
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+/*
+Maps positions to integer coordinates and back, at a fixed step. Positions inside the region come out as
+16-bit coordinates. Positions outside it keep going past 0 and 65535 at the same step, so a circle
+anywhere out to detail::world_extent is quantized as finely as one inside; encoders delta code the
+coordinates, so those only cost a longer varint. Coordinates are limited to +-2^29, so that the
+difference of any two fits in an int32_t.
+*/
+class quantizer
+{
+public:
+	explicit quantizer(const sf::FloatRect set_region) : region(set_region),
+		scale_x(65535.f / set_region.width), scale_y(65535.f / set_region.height) {}
+
+	int32_t x(const float x) const { return to_i32((x - region.left) * scale_x); }
+	int32_t y(const float y) const { return to_i32((y - region.top) * scale_y); }
+
+	sf::Vector2f position(const int32_t x, const int32_t y) const
+	{
+		return { region.left + x / scale_x, region.top + y / scale_y };
+	}
+
+	sf::FloatRect get_region() const { return region; }
+
+private:
+	// NaN comes out as the lower limit
+	static int32_t to_i32(const float v)
+	{
+		const float limit = float(1 << 29);
+		return (int32_t)std::floor(std::min(limit, std::max(-limit, v)) + .5f);
+	}
+
+	sf::FloatRect region;
+	float scale_x;
+	float scale_y;
+};
+
+// Small signed numbers become small unsigned numbers: 0, -1, 1, -2, 2... -> 0, 1, 2, 3, 4...
+uint32_t zigzag_encode(const int32_t v) { return (uint32_t(v) << 1) ^ uint32_t(v >> 31); }
+int32_t zigzag_decode(const uint32_t v) { return int32_t(v >> 1) ^ -int32_t(v & 1); }
+
+// Seven bits per byte, low bits first, with the high bit set on every byte but the last.
+// Values under 128 take one byte.
+void write_varint(std::vector<uint8_t>& out, uint32_t v)
+{
+	while (v >= 0x80)
+	{
+		out.push_back(uint8_t(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back(uint8_t(v));
+}
+
+uint32_t read_varint(const uint8_t*& in)
+{
+	uint32_t v = 0;
+	for (int shift = 0; ; shift += 7)
+	{
+		const uint8_t byte = *in++;
+		v |= uint32_t(byte & 0x7f) << shift;
+		if (byte < 0x80) return v;
+	}
+}
+
+// The same, for input that may be truncated or corrupt: fails rather than reading past `end`
+bool read_varint(const uint8_t*& in, const uint8_t* const end, uint32_t& v)
+{
+	v = 0;
+	for (int shift = 0; shift < 35 && in != end; shift += 7)
+	{
+		const uint8_t byte = *in++;
+		v |= uint32_t(byte & 0x7f) << shift;
+		if (byte < 0x80) return true;
+	}
+	return false;
+}
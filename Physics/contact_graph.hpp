@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "detail.hpp"
+#include "utility.hpp"
+#include "circle.hpp"
+#include "spatial_grid.hpp"
+
+struct contact
+{
+	uint32_t a;
+	uint32_t b;
+};
+
+// The circle pairs in contact this tick, split into colors so that no circle appears twice within a color.
+// Every pair in a color can then be resolved in parallel.
+class contact_graph
+{
+public:
+	static constexpr size_t max_colors = 64; // one bit per color; pairs that don't fit go into an extra, serial batch
+
+	void build(const circle_store& circles, const spatial_grid& grid)
+	{
+		find_contacts(circles, grid);
+		color_contacts(circles.size());
+	}
+
+	size_t color_count() const { return color_start.size() - 1; }
+
+	// the last color is the overflow batch, and is not guaranteed to be conflict-free
+	bool is_overflow(const size_t color) const { return color == max_colors; }
+
+	const contact* begin_of(const size_t color) const { return colored.data() + color_start[color]; }
+	size_t size_of(const size_t color) const { return color_start[color + 1] - color_start[color]; }
+
+private:
+	template<typename F>
+	void for_each_contact_of(const circle_store& circles, const spatial_grid& grid, const size_t i, F f) const
+	{
+		grid.for_each_near(circles.position(i), circles.radius(i) + grid.max_radius(), [&](const size_t j)
+		{
+			if (j > i && distance_between(circles.position(i), circles.position(j))
+				< circles.radius(i) + circles.radius(j) + detail::contact_margin)
+			{
+				f(j);
+			}
+		});
+	}
+
+	void find_contacts(const circle_store& circles, const spatial_grid& grid)
+	{
+		// count, scan, then fill, so that contacts come out in the same order for any number of threads
+		counts.resize(circles.size() + 1);
+
+		parallel_for(circles.size(), [&](const size_t i)
+		{
+			size_t count = 0;
+			for_each_contact_of(circles, grid, i, [&](const size_t) { ++count; });
+			counts[i] = count;
+		});
+
+		counts.back() = 0;
+		std::exclusive_scan(counts.begin(), counts.end(), counts.begin(), size_t(0));
+		contacts.resize(counts.back());
+
+		parallel_for(circles.size(), [&](const size_t i)
+		{
+			size_t k = counts[i];
+			for_each_contact_of(circles, grid, i, [&](const size_t j) { contacts[k++] = { (uint32_t)i, (uint32_t)j }; });
+		});
+	}
+
+	void color_contacts(const size_t circle_count)
+	{
+		// greedy: give each contact the lowest color that neither of its circles is using yet
+		used_colors.assign(circle_count, 0);
+		colors.resize(contacts.size());
+		color_start.assign(max_colors + 2, 0);
+
+		for (size_t i = 0; i < contacts.size(); ++i)
+		{
+			const auto [a, b] = contacts[i];
+			const uint64_t used = used_colors[a] | used_colors[b];
+
+			size_t color = 0;
+			while (color < max_colors && (used & (uint64_t(1) << color))) ++color;
+
+			if (color < max_colors)
+			{
+				used_colors[a] |= uint64_t(1) << color;
+				used_colors[b] |= uint64_t(1) << color;
+			}
+
+			colors[i] = (uint8_t)color;
+			++color_start[color + 1];
+		}
+
+		// bucket the contacts by color, keeping their order within each color
+		std::partial_sum(color_start.begin(), color_start.end(), color_start.begin());
+		colored.resize(contacts.size());
+
+		std::vector<size_t> cursor(color_start.begin(), color_start.end() - 1);
+		for (size_t i = 0; i < contacts.size(); ++i)
+		{
+			colored[cursor[colors[i]]++] = contacts[i];
+		}
+	}
+
+	std::vector<size_t> counts;
+	std::vector<contact> contacts;
+
+	std::vector<uint64_t> used_colors;
+	std::vector<uint8_t> colors;
+
+	std::vector<size_t> color_start;
+	std::vector<contact> colored;
+};
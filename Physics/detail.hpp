@@ -9,6 +9,8 @@ namespace detail
 
 	const sf::Color background = sf::Color::White;
 
+	const uint64_t random_seed = 20220421;
+
 	const size_t framerate = 144;
 	const float time_step = 1.f / framerate;
 
@@ -16,12 +18,78 @@ namespace detail
 
 	const float repulsion_force = 0.5f; // default is 0.5f; less is bouncier
 
+	const size_t solver_iterations = 4; // the most collision passes per tick; adjustable at runtime
+	const size_t max_solver_iterations = 32;
+	const float penetration_tolerance = 0.1f; // stop iterating once no overlap is deeper than this
+
 	const float circle_radius_min = 5.f;
 	const float circle_radius_max = 30.f;
 
+	const char* const snapshot_path = "world.snapshot";
+
+	const char* const barrier_text_path = "barriers.txt";
+	const char* const barrier_binary_path = "barriers.bin";
+
+	const char* const checkpoint_path = "checkpoint.snapshot";
+	const size_t checkpoint_interval = framerate * 60; // in ticks
+
+	const char* const trajectory_path = "trajectories.bin";
+	const sf::FloatRect export_region{ -2048.f, -4096.f, 8192.f, 8192.f }; // 16-bit coordinates, 1/8 px apart; see quantizer
+	const size_t export_queue_length = 8; // frames waiting to be written before new ones are dropped
+
+	const size_t rewind_budget = size_t(256) * 1024 * 1024; // bytes of compressed history to keep for scrubbing
+	const size_t rewind_keyframe_interval = framerate; // in ticks; the most frames decoded per seek
+	const sf::FloatRect rewind_region = export_region;
+
+	const size_t prefill_count = 200'000;
+	const float prefill_radius_min = 1.5f;
+	const float prefill_radius_max = 2.5f;
+
+	// mutual gravitation, when enabled
+	const float gravitational_constant = 100.f; // masses are radius squared
+	const float nbody_softening = 4.f; // keeps close encounters finite, in px
+	const float barnes_hut_theta = 0.7f; // how small a node must look before it's treated as one body; 0 is exact
+
+	// force fields
+	const size_t force_field_cols = 32;
+	const size_t force_field_rows = 18;
+	const size_t force_field_max_nodes_per_axis = 4096; // for loaded fields
+	const float force_field_strength = 800.f; // px per second squared, at the strongest
+	const char* const force_field_path = "field.txt";
+
+	// world bounds shaped by a signed distance are sampled on a grid this size
+	const size_t bounds_grid_cols = 96;
+	const size_t bounds_grid_rows = 58;
+
+	// mouse tools
+	const float tool_radius = 150.f;
+	const float tool_acceleration = 4000.f; // at the mouse, for attract and repel
+	const float explosion_speed = 1500.f; // added at the center of an explosion, in px per second
+
+	const size_t emitter_burst = 5; // circles per tick from each emitter added with the mouse
+
+	const float grid_max_cells_per_axis = 1024.f; // for the barrier grid
+
+	// the world has no edges, but circles this far from the origin (or at NaN) are deleted, before float positions get too coarse
+	const float world_extent = 1'000'000.f;
+
+	const float camera_zoom_step = 1.1f; // per notch of the mouse wheel
+
+	// the heatmap: one texel per this many pixels on each axis, and circles are counted in this many slices in parallel
+	const size_t heatmap_texel_size = 2;
+	const size_t heatmap_slices = 8;
+
+	const size_t vertex_upload_gap = 64; // unchanged circles between two changed ones that are uploaded anyway, to save an upload call
+
+	const float contact_margin = 1.f; // circles this close are treated as touching when building the contact graph
+
 	const sf::Color new_barrier_color = { 0, 0, 0, 255 / 2 };
 	const sf::Color barrier_color = { 0, 0, 0, 255 };
 	const sf::Color barrier_endcap_color = barrier_color;
+	const sf::Color hovered_barrier_color = { 96, 96, 96, 255 };
 	const float barrier_thickness = 10.f; // default is 7.5f
 	const float min_barrier_length = barrier_thickness;
+
+	// circles moving further than this fraction of the barrier thickness per step are swept against barriers
+	const float ccd_threshold = 0.25f;
 }
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <charconv>
+#include <string>
+#include <vector>
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include <SFML/Graphics.hpp>
+
+#include "detail.hpp"
+#include "utility.hpp"
+#include "circle.hpp"
+#include "grid_sampler.hpp"
+#include "mapped_file.hpp"
+
+/*
+An acceleration that varies over space, stored at the nodes of a coarse grid over a region and
+interpolated bilinearly in between.
+
+Field files are text: "left top width height cols rows", then cols * rows pairs of "x y" accelerations
+in px per second squared, row by row. Anything after a '#' on a line is skipped. A file with a value that
+isn't finite, or a node count that isn't a whole number from 2 to 4096, is rejected.
+*/
+class force_field
+{
+public:
+	force_field() = default;
+	force_field(const sf::FloatRect region, const size_t cols, const size_t rows)
+		: grid(region, cols, rows), fx(grid.node_count(), 0.f), fy(grid.node_count(), 0.f) {}
+
+	// a wind blowing left to right, in bands that are stronger and weaker
+	static force_field wind(const sf::FloatRect region)
+	{
+		force_field field{ region, detail::force_field_cols, detail::force_field_rows };
+		field.fill([&](const sf::Vector2f p)
+		{
+			const float band = .5f + .5f * sin((p.y - region.top) / region.height * 6.f * (float)M_PI);
+			return sf::Vector2f{ detail::force_field_strength * band, 0.f };
+		});
+		return field;
+	}
+
+	// a whirlpool around the center of the region, strongest a short way out from the center
+	static force_field whirlpool(const sf::FloatRect region)
+	{
+		force_field field{ region, detail::force_field_cols, detail::force_field_rows };
+		const sf::Vector2f center{ region.left + region.width / 2.f, region.top + region.height / 2.f };
+		const float core = std::min(region.width, region.height) / 4.f;
+
+		field.fill([&](const sf::Vector2f p)
+		{
+			const sf::Vector2f offset = p - center;
+			const float distance = std::max(sqrt(dot(offset, offset)), 1.f);
+			const float strength = detail::force_field_strength * 2.f * (distance / core) / (1.f + (distance / core) * (distance / core));
+
+			// mostly around, a little inward
+			const sf::Vector2f around{ -offset.y / distance, offset.x / distance };
+			return (around - offset / distance * .25f) * strength;
+		});
+		return field;
+	}
+
+	bool load(const std::string& path)
+	{
+		const mapped_file file{ path };
+		if (!file.is_open()) return false;
+
+		const char* p = (const char*)file.data();
+		const char* const end = p + file.size();
+
+		float header[6];
+		for (float& value : header)
+		{
+			if (!read_number(p, end, value)) return false;
+		}
+		if (!is_valid_header(header)) return false;
+
+		force_field loaded{ { header[0], header[1], header[2], header[3] }, (size_t)header[4], (size_t)header[5] };
+		for (size_t i = 0; i < loaded.fx.size(); ++i)
+		{
+			if (!read_number(p, end, loaded.fx[i]) || !read_number(p, end, loaded.fy[i])) return false;
+			if (!std::isfinite(loaded.fx[i]) || !std::isfinite(loaded.fy[i])) return false;
+		}
+
+		*this = std::move(loaded);
+		return true;
+	}
+
+	// Adds the field's acceleration to every circle's, four circles at a time
+	void apply(circle_store& circles) const
+	{
+		parallel_for_chunks(circles.size(), 4096, [&](const size_t, const size_t begin, const size_t end)
+		{
+			apply(circles, begin, end);
+		});
+	}
+
+private:
+	template<typename F>
+	void fill(F f)
+	{
+		for (size_t row = 0; row < grid.get_rows(); ++row)
+		{
+			for (size_t col = 0; col < grid.get_cols(); ++col)
+			{
+				const sf::Vector2f value = f(grid.node_position(col, row));
+				fx[row * grid.get_cols() + col] = value.x;
+				fy[row * grid.get_cols() + col] = value.y;
+			}
+		}
+	}
+
+	void apply(circle_store& circles, const size_t begin, const size_t end) const
+	{
+		const float* const px = circles.x.data();
+		const float* const py = circles.y.data();
+		float* const ax = circles.acceleration_x.data();
+		float* const ay = circles.acceleration_y.data();
+
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			size_t node[4];
+			__m128 tx, ty;
+			grid.locate(_mm_loadu_ps(px + i), _mm_loadu_ps(py + i), node, tx, ty);
+
+			_mm_storeu_ps(ax + i, _mm_add_ps(_mm_loadu_ps(ax + i), grid.sample(fx.data(), node, tx, ty)));
+			_mm_storeu_ps(ay + i, _mm_add_ps(_mm_loadu_ps(ay + i), grid.sample(fy.data(), node, tx, ty)));
+		}
+
+		// the remaining zero to three circles
+		for (; i < end; ++i)
+		{
+			size_t node;
+			float tx, ty;
+			grid.locate(px[i], py[i], node, tx, ty);
+
+			ax[i] += grid.sample(fx.data(), node, tx, ty);
+			ay[i] += grid.sample(fy.data(), node, tx, ty);
+		}
+	}
+
+	// A finite region with a positive size, and a whole number of nodes per axis that is small enough to allocate
+	static bool is_valid_header(const float header[6])
+	{
+		for (size_t i = 0; i < 6; ++i)
+		{
+			if (!std::isfinite(header[i])) return false;
+		}
+		if (!std::isfinite(header[0] + header[2]) || !std::isfinite(header[1] + header[3])) return false;
+		if (header[2] <= 0.f || header[3] <= 0.f) return false;
+
+		for (const float nodes : { header[4], header[5] })
+		{
+			if (nodes < 2.f || nodes > (float)detail::force_field_max_nodes_per_axis || nodes != std::floor(nodes)) return false;
+		}
+		return true;
+	}
+
+	// skips whitespace and comments, then reads one number
+	static bool read_number(const char*& p, const char* const end, float& value)
+	{
+		while (p != end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' || *p == '#'))
+		{
+			if (*p == '#') p = std::find(p, end, '\n');
+			else ++p;
+		}
+
+		const auto [next, error] = std::from_chars(p, end, value);
+		p = next;
+		return error == std::errc{};
+	}
+
+	grid_sampler grid;
+	std::vector<float> fx = std::vector<float>(4, 0.f); // px per second squared, at each node
+	std::vector<float> fy = std::vector<float>(4, 0.f);
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#include <SFML/Graphics.hpp>
+
+// Interpolates values stored at the nodes of a grid over a region, bilinearly. Positions outside the
+// region get the value at the nearest edge. Values live with the caller, one per node, row by row.
+class grid_sampler
+{
+public:
+	grid_sampler() = default;
+	grid_sampler(const sf::FloatRect set_region, const size_t set_cols, const size_t set_rows)
+		: region(set_region), cols(std::max(set_cols, size_t(2))), rows(std::max(set_rows, size_t(2))) {}
+
+	size_t node_count() const { return cols * rows; }
+	size_t get_cols() const { return cols; }
+	size_t get_rows() const { return rows; }
+	sf::FloatRect get_region() const { return region; }
+
+	sf::Vector2f node_position(const size_t col, const size_t row) const
+	{
+		return { region.left + region.width * col / (cols - 1), region.top + region.height * row / (rows - 1) };
+	}
+
+	// Where four positions fall: the top left node of each one's cell, and how far across the cell it is
+	void locate(const __m128 x, const __m128 y, size_t node[4], __m128& tx, __m128& ty) const
+	{
+		const __m128 gx = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(x, _mm_set1_ps(region.left)), _mm_set1_ps(scale_x())), _mm_setzero_ps()), _mm_set1_ps(float(cols - 1)));
+		const __m128 gy = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(y, _mm_set1_ps(region.top)), _mm_set1_ps(scale_y())), _mm_setzero_ps()), _mm_set1_ps(float(rows - 1)));
+		const __m128 cell_x = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(gx)), _mm_set1_ps(float(cols - 2)));
+		const __m128 cell_y = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(gy)), _mm_set1_ps(float(rows - 2)));
+		tx = _mm_sub_ps(gx, cell_x);
+		ty = _mm_sub_ps(gy, cell_y);
+
+		alignas(16) int32_t cx[4];
+		alignas(16) int32_t cy[4];
+		_mm_store_si128((__m128i*)cx, _mm_cvttps_epi32(cell_x));
+		_mm_store_si128((__m128i*)cy, _mm_cvttps_epi32(cell_y));
+
+		for (int k = 0; k < 4; ++k) node[k] = (size_t)cy[k] * cols + cx[k];
+	}
+
+	// the same, for one position, with the same operations in the same order
+	void locate(const float x, const float y, size_t& node, float& tx, float& ty) const
+	{
+		const float gx = std::min(std::max((x - region.left) * scale_x(), 0.f), float(cols - 1));
+		const float gy = std::min(std::max((y - region.top) * scale_y(), 0.f), float(rows - 1));
+		const float cell_x = std::min(float(int32_t(gx)), float(cols - 2));
+		const float cell_y = std::min(float(int32_t(gy)), float(rows - 2));
+		tx = gx - cell_x;
+		ty = gy - cell_y;
+		node = (size_t)cell_y * cols + (size_t)cell_x;
+	}
+
+	__m128 sample(const float* const v, const size_t node[4], const __m128 tx, const __m128 ty) const
+	{
+		// SSE has no gather, so each lane's four nodes are loaded one by one
+		const __m128 top_left = _mm_setr_ps(v[node[0]], v[node[1]], v[node[2]], v[node[3]]);
+		const __m128 top_right = _mm_setr_ps(v[node[0] + 1], v[node[1] + 1], v[node[2] + 1], v[node[3] + 1]);
+		const __m128 bottom_left = _mm_setr_ps(v[node[0] + cols], v[node[1] + cols], v[node[2] + cols], v[node[3] + cols]);
+		const __m128 bottom_right = _mm_setr_ps(v[node[0] + cols + 1], v[node[1] + cols + 1], v[node[2] + cols + 1], v[node[3] + cols + 1]);
+
+		const __m128 top = _mm_add_ps(top_left, _mm_mul_ps(_mm_sub_ps(top_right, top_left), tx));
+		const __m128 bottom = _mm_add_ps(bottom_left, _mm_mul_ps(_mm_sub_ps(bottom_right, bottom_left), tx));
+		return _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), ty));
+	}
+
+	float sample(const float* const v, const size_t node, const float tx, const float ty) const
+	{
+		const float top = v[node] + (v[node + 1] - v[node]) * tx;
+		const float bottom = v[node + cols] + (v[node + cols + 1] - v[node + cols]) * tx;
+		return top + (bottom - top) * ty;
+	}
+
+private:
+	float scale_x() const { return (cols - 1) / region.width; }
+	float scale_y() const { return (rows - 1) / region.height; }
+
+	sf::FloatRect region{ 0.f, 0.f, 1.f, 1.f };
+	size_t cols = 2;
+	size_t rows = 2;
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "detail.hpp"
+#include "utility.hpp"
+#include "circle.hpp"
+
+enum class heatmap_mode
+{
+	off,
+	density, // circles per texel
+	speed // the average speed of the circles in each texel
+};
+
+/*
+Shows a huge number of circles as a single texture: circle centers are counted into a coarse buffer
+over the view, which is tone mapped and uploaded once per frame.
+
+Circles are split into a fixed number of slices, each counted into its own buffer in parallel, and the
+slices are summed in order, so the picture does not depend on the number of threads.
+*/
+class heatmap
+{
+public:
+	heatmap(const size_t set_width, const size_t set_height)
+		: width(set_width), height(set_height), pixels(width * height * 4)
+	{
+		// background, then blue, red, and yellow as a texel gets hotter
+		const sf::Color stops[] = { detail::background, { 40, 60, 200 }, { 220, 30, 30 }, { 255, 230, 40 } };
+		for (size_t i = 0; i < palette.size(); ++i)
+		{
+			const float t = float(i) / (palette.size() - 1) * 3.f;
+			const size_t stop = std::min(size_t(t), size_t(2));
+			const float f = t - stop;
+			const auto mix = [&](const uint8_t a, const uint8_t b) { return uint8_t(a + (b - a) * f); };
+			palette[i] = { mix(stops[stop].r, stops[stop + 1].r), mix(stops[stop].g, stops[stop + 1].g), mix(stops[stop].b, stops[stop + 1].b) };
+		}
+	}
+
+	// Splats the circles inside the view rectangle, tone maps them, and uploads the result
+	void update(const circle_store& circles, const sf::Vector2f view_min, const sf::Vector2f view_size, const heatmap_mode mode)
+	{
+		const size_t texels = width * height;
+		count.resize(detail::heatmap_slices * texels);
+		speed.resize(detail::heatmap_slices * texels);
+
+		const float scale_x = width / view_size.x;
+		const float scale_y = height / view_size.y;
+		const size_t slice_size = std::max((circles.size() + detail::heatmap_slices - 1) / detail::heatmap_slices, size_t(1));
+
+		parallel_for_chunks(circles.size(), slice_size, [&](const size_t slice, const size_t begin, const size_t end)
+		{
+			uint32_t* const slice_count = count.data() + slice * texels;
+			float* const slice_speed = speed.data() + slice * texels;
+			std::fill(slice_count, slice_count + texels, 0u);
+			if (mode == heatmap_mode::speed) std::fill(slice_speed, slice_speed + texels, 0.f);
+
+			for (size_t i = begin; i < end; ++i)
+			{
+				const float tx = (circles.x[i] - view_min.x) * scale_x;
+				const float ty = (circles.y[i] - view_min.y) * scale_y;
+				if (!(tx >= 0.f && tx < width && ty >= 0.f && ty < height)) continue;
+
+				const size_t texel = size_t(ty) * width + size_t(tx);
+				++slice_count[texel];
+				if (mode == heatmap_mode::speed)
+				{
+					const sf::Vector2f v = circles.velocity(i);
+					slice_speed[texel] += sqrt(v.x * v.x + v.y * v.y);
+				}
+			}
+		});
+
+		// sum the slices into the first, in slice order
+		const size_t used_slices = (circles.size() + slice_size - 1) / slice_size;
+		parallel_for(texels, [&](const size_t texel)
+		{
+			for (size_t slice = 1; slice < used_slices; ++slice)
+			{
+				count[texel] += count[slice * texels + texel];
+				if (mode == heatmap_mode::speed) speed[texel] += speed[slice * texels + texel];
+			}
+
+			// from here on, speed holds the value to show
+			if (mode == heatmap_mode::density) speed[texel] = (float)count[texel];
+			else if (count[texel] > 0) speed[texel] /= count[texel];
+		}, 4096);
+
+		// densities span orders of magnitude, so they are shown on a log scale
+		const float max = parallel_max(texels, [&](const size_t texel) { return speed[texel]; }, 4096);
+		const float log_max = std::log1p(max);
+
+		parallel_for(texels, [&](const size_t texel)
+		{
+			float t = 0.f;
+			if (count[texel] > 0 && max > 0.f)
+			{
+				t = (mode == heatmap_mode::density) ? std::log1p(speed[texel]) / log_max : speed[texel] / max;
+			}
+
+			// even the coolest occupied texel is told apart from an empty one
+			const sf::Color color = count[texel] > 0 ? palette[1 + size_t(t * (palette.size() - 2))] : palette[0];
+			pixels[texel * 4 + 0] = color.r;
+			pixels[texel * 4 + 1] = color.g;
+			pixels[texel * 4 + 2] = color.b;
+			pixels[texel * 4 + 3] = 255;
+		}, 4096);
+
+		// created on first use, so that a headless Physics never needs a graphics context
+		if (texture.getSize().x == 0)
+		{
+			texture.create((unsigned)width, (unsigned)height);
+			sprite.setTexture(texture, true);
+		}
+		texture.update(pixels.data());
+	}
+
+	// scaled to cover a target of the given size
+	const sf::Sprite& get_sprite(const sf::Vector2f target_size)
+	{
+		sprite.setScale(target_size.x / width, target_size.y / height);
+		return sprite;
+	}
+
+private:
+	size_t width;
+	size_t height;
+
+	std::vector<uint32_t> count; // per slice, then per texel
+	std::vector<float> speed; // the same, in px per time step
+	std::vector<uint8_t> pixels; // RGBA
+
+	std::array<sf::Color, 256> palette;
+	sf::Texture texture;
+	sf::Sprite sprite;
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A read-only view of a whole file, mapped into memory. The view is empty if the file could not be mapped.
+class mapped_file
+{
+public:
+	explicit mapped_file(const std::string& path)
+	{
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return;
+
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) return;
+
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr) return;
+
+		view = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (view != nullptr) length = (size_t)file_size.QuadPart;
+#else
+		fd = open(path.c_str(), O_RDONLY);
+		if (fd == -1) return;
+
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0) return;
+
+		void* address = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (address == MAP_FAILED) return;
+
+		view = (const uint8_t*)address;
+		length = (size_t)info.st_size;
+#endif
+	}
+
+	~mapped_file()
+	{
+#ifdef _WIN32
+		if (view != nullptr) UnmapViewOfFile(view);
+		if (mapping != nullptr) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+		if (view != nullptr) munmap((void*)view, length);
+		if (fd != -1) close(fd);
+#endif
+	}
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	bool is_open() const { return view != nullptr; }
+	const uint8_t* data() const { return view; }
+	size_t size() const { return length; }
+
+private:
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+	const uint8_t* view = nullptr;
+	size_t length = 0;
+};
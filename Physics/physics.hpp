@@ -13,22 +13,72 @@
 #include "detail.hpp"
 #include "circle.hpp"
 #include "barrier.hpp"
+#include "barrier_grid.hpp"
+#include "barrier_layout.hpp"
+#include "spatial_grid.hpp"
+#include "contact_graph.hpp"
+#include "barnes_hut.hpp"
+#include "force_field.hpp"
+#include "world_bounds.hpp"
+#include "heatmap.hpp"
+#include "circle_vertex_buffer.hpp"
+#include "snapshot.hpp"
+#include "replay.hpp"
+#include "trajectory_exporter.hpp"
+#include "checkpointer.hpp"
+#include "rewind_buffer.hpp"
+
+// What the left mouse button does
+enum class mouse_tool
+{
+	barriers, // draw a barrier
+	attract, // pull circles near the mouse toward it, while held
+	repel, // push them away, while held
+	explode, // push them away once, on click
+	erase // delete them, while held
+};
 
-float distance_between(const circle& c1, const circle& c2)
+enum class field_kind
 {
-	return ::distance_between(c1.position(), c2.position());
-}
+	none,
+	wind,
+	whirlpool,
+	loaded // from detail::force_field_path
+};
 
-bool are_touching(const circle& c1, const circle& c2)
+enum class solver_mode
 {
-	return distance_between(c1, c2) < c1.radius() + c2.radius();
-}
+	gauss_seidel, // resolve each pair in place, in order
+	jacobi, // accumulate corrections from all contacts, then apply them at once
+	colored // resolve in place, one batch of independent contacts at a time
+};
 
 class Physics
 {
 public:
-	Physics()
+	// A headless Physics has no window, and is only driven by replay()
+	explicit Physics(const bool headless = false)
 	{
+		// one shape draws every circle, scaled to each one's radius
+		circle_shape.setRadius(1.f);
+		circle_shape.setPointCount(30);
+		circle_shape.setOrigin(1.f, 1.f);
+
+		// likewise for barriers: a unit rectangle, stretched between the end points, and a unit end cap
+		barrier_body.setSize({ 1.f, 1.f });
+		barrier_body.setOrigin(0.f, .5f);
+		barrier_cap.setRadius(1.f);
+		barrier_cap.setPointCount(30);
+		barrier_cap.setOrigin(1.f, 1.f);
+		barrier_cap.setFillColor(detail::barrier_endcap_color);
+
+		// replays are for timing the simulation, so they don't pay for rewind history
+		if (headless)
+		{
+			rewinding = false;
+			return;
+		}
+
 		sf::ContextSettings settings;
 		settings.antialiasingLevel = 8;
 		window = std::make_unique<sf::RenderWindow>(
@@ -38,6 +88,7 @@ public:
 			settings);
 
 		window->setFramerateLimit(detail::framerate);
+		camera = window->getDefaultView();
 
 		const std::string ARIAL_LOCATION = "C:/Windows/Fonts/Arial.ttf";
 		if (!arial.loadFromFile(ARIAL_LOCATION))
@@ -52,6 +103,12 @@ public:
 		pointer_click_helper.setFillColor({ 0, 0, 0, 255 / 2 });
 		pointer_click_helper.setPosition({ -100.f, -100.f });
 
+		tool_outline.setRadius(detail::tool_radius);
+		tool_outline.setOrigin(detail::tool_radius, detail::tool_radius);
+		tool_outline.setFillColor(sf::Color::Transparent);
+		tool_outline.setOutlineColor({ 0, 0, 0, 255 / 4 });
+		tool_outline.setOutlineThickness(2.f);
+
 		overlay.setFont(arial);
 		overlay.setCharacterSize(20);
 		overlay.setFillColor(sf::Color::Black);
@@ -60,18 +117,39 @@ public:
 
 private:
 
-	void erase_barrier()
+	// Erases every barrier that the mouse passed over on its way from `from` to `to`
+	void erase_barriers(const sf::Vector2f from, const sf::Vector2f to)
 	{
-		for (auto it = barriers.cbegin(); it != barriers.cend(); ++it)
+		erased.clear();
+
+		const sf::Vector2f min{ std::min(from.x, to.x), std::min(from.y, to.y) };
+		const sf::Vector2f max{ std::max(from.x, to.x), std::max(from.y, to.y) };
+		barrier_index.for_each_near(min, max, [&](const size_t k)
 		{
-			if (it->is_mouse_over(mouse_pos))
-			{
-				barriers.erase(it);
-				return; // mouse only removes one barrier at a time	
-			}
+			if (barriers[k].is_crossed_by(from, to)) erased.push_back(k);
+		});
+
+		// highest first, so that the barrier moved into each hole is never one still to be erased
+		std::sort(erased.begin(), erased.end(), std::greater<size_t>());
+		for (const size_t k : erased)
+		{
+			barrier_index.swap_remove(k);
+			barriers[k] = barriers.back();
+			barriers.pop_back();
 		}
 	}
 
+	// The barrier under the given point, or SIZE_MAX
+	size_t barrier_at(const sf::Vector2f point) const
+	{
+		size_t found = SIZE_MAX;
+		barrier_index.for_each_near(point, point, [&](const size_t k)
+		{
+			if (barriers[k].is_mouse_over(point)) found = std::min(found, k);
+		});
+		return found;
+	}
+
 	void reset_new_barrier()
 	{
 		new_barrier.reset();
@@ -87,7 +165,7 @@ private:
 
 		if (rmb_pressed && !lmb_pressed) // dragging with right button only
 		{
-			erase_barrier();
+			erase_barriers(previous_mouse_pos, mouse_pos);
 		}
 	}
 
@@ -95,6 +173,13 @@ private:
 	{
 		lmb_pressed = true;
 
+		if (tool != mouse_tool::barriers)
+		{
+			// tools act during the next tick, once the grid is up to date
+			if (tool == mouse_tool::explode) explosion_pending = true;
+			return;
+		}
+
 		mouse_clicked_pos = mouse_pos;
 
 		drawing_barrier = true;
@@ -111,6 +196,7 @@ private:
 			{
 				barriers.push_back(new_barrier);
 				barriers.back().set_to_default_color();
+				barrier_index.build(barriers);
 			}
 
 			reset_new_barrier();
@@ -129,7 +215,7 @@ private:
 		else
 		{
 			// erase an existing barrier
-			erase_barrier();
+			erase_barriers(mouse_pos, mouse_pos);
 		}
 	}
 	void on_rmb_release()
@@ -137,9 +223,224 @@ private:
 		rmb_pressed = false;
 	}
 
+	void on_e()
+	{
+		emitters.push_back({ mouse_pos, detail::emitter_burst });
+	}
+	void on_ctrl_e()
+	{
+		emitters.resize(1);
+	}
+	void on_p()
+	{
+		// a benchmark pile: fill the window, and two window-heights above it
+		prefill(detail::prefill_count,
+			{ 0.f, -2.f * detail::window_height, (float)detail::window_width, 3.f * detail::window_height },
+			detail::prefill_radius_min, detail::prefill_radius_max);
+	}
+	// Reuses the memory already in `state`, so repeated captures cost one copy per array
+	void capture_state(world_state& state) const
+	{
+		state.tick = tick_counter;
+		state.rng = rng;
+		state.circles = circles;
+
+		state.barriers.clear();
+		for (const auto& barrier : barriers)
+		{
+			state.barriers.push_back({ barrier.get_a(), barrier.get_b(), barrier.get_radius() });
+		}
+	}
+
+	void restore_state(world_state&& state)
+	{
+		tick_counter = (size_t)state.tick;
+		rng = state.rng;
+		circles = std::move(state.circles);
+		grid.build(circles);
+		exporter.restart();
+
+		barriers.clear();
+		for (auto& saved : state.barriers)
+		{
+			barriers.emplace_back(saved.a, saved.b, saved.radius * 2.f);
+			barriers.back().set_to_default_color();
+		}
+		barrier_index.build(barriers);
+
+		reset_new_barrier();
+		rewind.clear();
+	}
+
+	void on_f5()
+	{
+		const auto start = current_time_in_us();
+
+		world_state state;
+		capture_state(state);
+		const bool saved = save_snapshot(state, detail::snapshot_path);
+
+		std::stringstream ss;
+		ss << (saved ? "Saved " : "Could not save ") << detail::snapshot_path << " in " << (current_time_in_us() - start) / 1000.f << " ms";
+		status = ss.str();
+	}
+	void on_f9()
+	{
+		const auto start = current_time_in_us();
+		world_state state;
+		const bool loaded = load_snapshot(state, detail::snapshot_path);
+		if (loaded) restore_state(std::move(state));
+
+		std::stringstream ss;
+		ss << (loaded ? "Loaded " : "Could not load ") << detail::snapshot_path << " in " << (current_time_in_us() - start) / 1000.f << " ms";
+		status = ss.str();
+	}
+	void on_f6(const bool shift)
+	{
+		const auto start = current_time_in_us();
+
+		const char* const path = shift ? detail::barrier_binary_path : detail::barrier_text_path;
+		const bool saved = save_barriers(barriers, path, shift ? layout_format::binary : layout_format::text);
+
+		std::stringstream ss;
+		ss << (saved ? "Exported " : "Could not export ") << barriers.size() << " barriers to " << path << " in "
+			<< (current_time_in_us() - start) / 1000.f << " ms";
+		status = ss.str();
+	}
+	void on_f7(const bool shift)
+	{
+		load_barriers_from(shift ? detail::barrier_binary_path : detail::barrier_text_path);
+	}
+	void on_x()
+	{
+		if (exporter.is_running())
+		{
+			exporter.stop();
+		}
+		else if (!exporter.start(detail::trajectory_path, detail::export_region))
+		{
+			status = std::string("Could not write to ") + detail::trajectory_path;
+		}
+	}
+	void on_k()
+	{
+		checkpointing = !checkpointing;
+	}
+	// Turning rewind history off frees it, and turning it back on starts from the next tick
+	void on_r()
+	{
+		rewinding = !rewinding;
+		rewind = rewind_buffer{ detail::rewind_region };
+	}
+	void on_space()
+	{
+		paused = !paused;
+		if (paused && !rewind.empty()) seek(rewind.newest_tick());
+	}
+	// While paused, scrubs through the retained ticks, one at a time or (with shift) a second at a time
+	void on_left(const bool shift)
+	{
+		if (!paused || rewind.empty()) return;
+		const uint64_t step = shift ? detail::framerate : 1;
+		seek(rewind_tick - std::min(step, rewind_tick - rewind.oldest_tick()));
+	}
+	void on_right(const bool shift)
+	{
+		if (!paused || rewind.empty()) return;
+		const uint64_t step = shift ? detail::framerate : 1;
+		seek(rewind_tick + std::min(step, rewind.newest_tick() - rewind_tick));
+	}
+	void seek(const uint64_t tick)
+	{
+		rewind_tick = tick;
+		rewind.seek(rewind_tick, rewound);
+	}
+	void on_t()
+	{
+		switch (tool)
+		{
+			case mouse_tool::barriers: tool = mouse_tool::attract; break;
+			case mouse_tool::attract: tool = mouse_tool::repel; break;
+			case mouse_tool::repel: tool = mouse_tool::explode; break;
+			case mouse_tool::explode: tool = mouse_tool::erase; break;
+			case mouse_tool::erase: tool = mouse_tool::barriers; break;
+		}
+
+		reset_new_barrier();
+	}
+	void on_g()
+	{
+		mutual_gravity = !mutual_gravity;
+	}
+	void on_comma()
+	{
+		theta = std::max(0.f, theta - .1f);
+	}
+	void on_period()
+	{
+		theta = std::min(1.5f, theta + .1f);
+	}
+	void on_f(const bool shift)
+	{
+		const sf::FloatRect window_area{ 0.f, 0.f, (float)detail::window_width, (float)detail::window_height };
+
+		if (shift)
+		{
+			if (force.load(detail::force_field_path)) field = field_kind::loaded;
+			else status = std::string("Could not load ") + detail::force_field_path;
+			return;
+		}
+
+		switch (field)
+		{
+			case field_kind::none: field = field_kind::wind; force = force_field::wind(window_area); break;
+			case field_kind::wind: field = field_kind::whirlpool; force = force_field::whirlpool(window_area); break;
+			default: field = field_kind::none; break;
+		}
+	}
+	void on_b()
+	{
+		const sf::FloatRect window_area{ 0.f, 0.f, (float)detail::window_width, (float)detail::window_height };
+		const sf::Vector2f center{ detail::window_width / 2.f, detail::window_height / 2.f };
+
+		switch (bounds.get_shape())
+		{
+			case bounds_shape::none: bounds = world_bounds::box(window_area); break;
+			case bounds_shape::box: bounds = world_bounds::circle(center, std::min(center.x, center.y)); break;
+			case bounds_shape::circle: bounds = world_bounds::hourglass(window_area); break;
+			default: bounds = world_bounds{}; break;
+		}
+	}
+	void on_h()
+	{
+		switch (heat)
+		{
+			case heatmap_mode::off: heat = heatmap_mode::density; break;
+			case heatmap_mode::density: heat = heatmap_mode::speed; break;
+			default: heat = heatmap_mode::off; break;
+		}
+	}
 	void on_ctrl_c()
 	{
-		std::vector<circle>().swap(circles);
+		circles.clear();
+		grid.build(circles);
+	}
+	void on_s()
+	{
+		switch (solver)
+		{
+			case solver_mode::gauss_seidel: solver = solver_mode::jacobi; break;
+			case solver_mode::jacobi: solver = solver_mode::colored; break;
+			case solver_mode::colored: solver = solver_mode::gauss_seidel; break;
+		}
+	}
+	void on_left_bracket()
+	{
+		if (solver_iterations > 1) --solver_iterations;
+	}
+	void on_right_bracket()
+	{
+		if (solver_iterations < detail::max_solver_iterations) ++solver_iterations;
 	}
 	void on_key_pressed(const sf::Event::KeyEvent key)
 	{
@@ -149,50 +450,252 @@ private:
 		{
 			on_ctrl_c();
 		}
+		else if (key.control && key.code == sf::Keyboard::Key::E)
+		{
+			on_ctrl_e();
+		}
+		else if (key.code == sf::Keyboard::Key::E)
+		{
+			on_e();
+		}
+		else if (key.code == sf::Keyboard::Key::P)
+		{
+			on_p();
+		}
+		else if (key.code == sf::Keyboard::Key::X)
+		{
+			on_x();
+		}
+		else if (key.code == sf::Keyboard::Key::H)
+		{
+			on_h();
+		}
+		else if (key.code == sf::Keyboard::Key::B)
+		{
+			on_b();
+		}
+		else if (key.code == sf::Keyboard::Key::F)
+		{
+			on_f(key.shift);
+		}
+		else if (key.code == sf::Keyboard::Key::G)
+		{
+			on_g();
+		}
+		else if (key.code == sf::Keyboard::Key::Comma)
+		{
+			on_comma();
+		}
+		else if (key.code == sf::Keyboard::Key::Period)
+		{
+			on_period();
+		}
+		else if (key.code == sf::Keyboard::Key::T)
+		{
+			on_t();
+		}
+		else if (key.code == sf::Keyboard::Key::K)
+		{
+			on_k();
+		}
+		else if (key.code == sf::Keyboard::Key::Space)
+		{
+			on_space();
+		}
+		else if (key.code == sf::Keyboard::Key::Left)
+		{
+			on_left(key.shift);
+		}
+		else if (key.code == sf::Keyboard::Key::Right)
+		{
+			on_right(key.shift);
+		}
+		else if (key.code == sf::Keyboard::Key::F5)
+		{
+			on_f5();
+		}
+		else if (key.code == sf::Keyboard::Key::F6)
+		{
+			on_f6(key.shift);
+		}
+		else if (key.code == sf::Keyboard::Key::F7)
+		{
+			on_f7(key.shift);
+		}
+		else if (key.code == sf::Keyboard::Key::F9)
+		{
+			on_f9();
+		}
+		else if (key.code == sf::Keyboard::Key::S)
+		{
+			on_s();
+		}
+		else if (key.code == sf::Keyboard::Key::LBracket)
+		{
+			on_left_bracket();
+		}
+		else if (key.code == sf::Keyboard::Key::RBracket)
+		{
+			on_right_bracket();
+		}
 		else if (key.code >= sf::Keyboard::Key::A && key.code <= sf::Keyboard::Key::Z)
 		{
 
 		}
 	}
 
+	// Every user input goes through here, so that it can be recorded and replayed
+	void apply_input(const input_action& action)
+	{
+		recorder.record(action);
+
+		previous_mouse_pos = mouse_pos;
+		mouse_pos = action.position;
+
+		switch (action.type)
+		{
+			case input_type::mouse_moved:
+				on_mouse_moved();
+				break;
+
+			case input_type::lmb_pressed:
+				on_lmb_click();
+				break;
+
+			case input_type::lmb_released:
+				on_lmb_release();
+				break;
+
+			case input_type::rmb_pressed:
+				on_rmb_click();
+				break;
+
+			case input_type::rmb_released:
+				on_rmb_release();
+				break;
+
+			case input_type::key_pressed:
+			{
+				sf::Event::KeyEvent key{};
+				key.code = (sf::Keyboard::Key)action.key;
+				key.control = (action.modifiers & modifier_control) != 0;
+				key.shift = (action.modifiers & modifier_shift) != 0;
+				key.alt = (action.modifiers & modifier_alt) != 0;
+				on_key_pressed(key);
+				break;
+			}
+		}
+	}
+
+	sf::Vector2f to_world(const sf::Vector2i pixel) const
+	{
+		return window->mapPixelToCoords(pixel, camera);
+	}
+
 	void handle_events()
 	{
 		using namespace detail;
 
+		/*
+		A fast mouse can report hundreds of moves per frame. Only the latest position is applied, once,
+		just before the next other event or at the end of the frame; erasing covers the whole path since
+		the last applied position, so nothing is skipped.
+		*/
+		bool moved = false;
+		sf::Vector2f moved_to;
+		const auto apply_move = [&]
+		{
+			if (!moved) return;
+			apply_input({ recorder.tick(), input_type::mouse_moved, 0, 0, 0, moved_to });
+			moved = false;
+		};
+
 		sf::Event event;
 		while (window->pollEvent(event))
 		{
+			if (event.type != sf::Event::MouseMoved) apply_move();
+
+			input_action action{ recorder.tick(), input_type::mouse_moved, 0, 0, 0, mouse_pos };
+
 			switch (event.type)
 			{
 				case sf::Event::MouseMoved:
-					mouse_pos = { (float)event.mouseMove.x, (float)event.mouseMove.y };
-					on_mouse_moved();
+				{
+					const sf::Vector2i pixel{ event.mouseMove.x, event.mouseMove.y };
+					if (panning)
+					{
+						// drag the world along with the mouse
+						camera.move(sf::Vector2f(pan_from - pixel) * (camera.getSize().x / window->getSize().x));
+						pan_from = pixel;
+					}
+
+					moved = true;
+					moved_to = to_world(pixel);
+					break;
+				}
+
+				case sf::Event::MouseWheelScrolled:
+				{
+					// zoom around the point under the mouse, so that it stays put
+					const sf::Vector2i pixel{ event.mouseWheelScroll.x, event.mouseWheelScroll.y };
+					const sf::Vector2f before = to_world(pixel);
+					camera.zoom(std::pow(detail::camera_zoom_step, -event.mouseWheelScroll.delta));
+					camera.move(before - to_world(pixel));
+
+					moved = true;
+					moved_to = before;
 					break;
+				}
 
 				case sf::Event::MouseButtonPressed:
-					if (event.mouseButton.button == sf::Mouse::Button::Left)
+				case sf::Event::MouseButtonReleased:
+				{
+					const bool pressed = event.type == sf::Event::MouseButtonPressed;
+					const sf::Vector2i pixel{ event.mouseButton.x, event.mouseButton.y };
+					action.position = to_world(pixel);
+
+					if (event.mouseButton.button == sf::Mouse::Button::Middle)
+					{
+						panning = pressed;
+						pan_from = pixel;
+					}
+					else if (event.mouseButton.button == sf::Mouse::Button::Left)
 					{
-						on_lmb_click();
+						action.type = pressed ? input_type::lmb_pressed : input_type::lmb_released;
+						apply_input(action);
 					}
 					else if (event.mouseButton.button == sf::Mouse::Button::Right)
 					{
-						on_rmb_click();
+						action.type = pressed ? input_type::rmb_pressed : input_type::rmb_released;
+						apply_input(action);
 					}
 					break;
+				}
 
-				case sf::Event::MouseButtonReleased:
-					if (event.mouseButton.button == sf::Mouse::Button::Left)
+				case sf::Event::KeyPressed:
+					if (event.key.code == sf::Keyboard::Key::Unknown) break;
+
+					// the camera and rewind history only change what can be shown, so they are not recorded
+					if (event.key.code == sf::Keyboard::Key::Home)
 					{
-						on_lmb_release();
+						camera = window->getDefaultView();
+						moved = true;
+						moved_to = to_world(sf::Mouse::getPosition(*window));
+						break;
 					}
-					else if (event.mouseButton.button == sf::Mouse::Button::Right)
+					if (event.key.code == sf::Keyboard::Key::R)
 					{
-						on_rmb_release();
+						on_r();
+						break;
 					}
-					break;
 
-				case sf::Event::KeyPressed:
-					on_key_pressed(event.key);
+					action.type = input_type::key_pressed;
+					action.key = (uint8_t)event.key.code;
+					action.modifiers = uint8_t(
+						(event.key.control ? modifier_control : 0) |
+						(event.key.shift ? modifier_shift : 0) |
+						(event.key.alt ? modifier_alt : 0));
+					apply_input(action);
 					break;
 
 				case sf::Event::Closed:
@@ -200,203 +703,458 @@ private:
 					break;
 			}
 		}
-	}
-
 
+		apply_move();
+	}
 
-	void try_spawn_circle()
+	// The size of the circle determines the color (min: 255,0,0 max: 0,0,255)
+	// Bigger circle = less red and more blue
+	static sf::Color color_for_radius(const float radius)
 	{
-		const sf::Vector2f spawn_point = { detail::window_width * .6f, 50.f };
-
-		sf::CircleShape sf_circle{ detail::circle_radius_max, 30 };
-		sf_circle.setOrigin(detail::circle_radius_max, detail::circle_radius_max);
-		sf_circle.setPosition(spawn_point);
-
-		// make sure a circle of any size could spawn here
-		for (size_t i = 0; i < circles.size(); ++i)
-		{
-			if (distance_between(circles[i].position(), sf_circle.getPosition())
-				< circles[i].radius() + detail::circle_radius_max)
-			{
-				return; // fail silently
-			}
-		}
-
-		// configure this circle correctly now
-		const float radius = random_float_from(detail::circle_radius_min, detail::circle_radius_max);
-		sf_circle.setRadius(radius);
-		sf_circle.setOrigin(radius, radius); // never perform corrections anywhere else! :D
-		sf_circle.setPosition(spawn_point);
-
-		// The size of the circle determines the color (min: 255,0,0 max: 0,0,255)
-		// Bigger circle = less red and more blue
 		const uint8_t color_scaling = uint8_t(
 			(radius - detail::circle_radius_min)
 			/ (detail::circle_radius_max - detail::circle_radius_min)
 			* 255.f);
 
-		sf_circle.setFillColor({ uint8_t(255u - color_scaling), 0, color_scaling });
+		return { uint8_t(255u - color_scaling), 0, color_scaling };
+	}
 
-		circles.push_back(circle{ sf_circle });
+	// Returns true if a circle of the given radius would not overlap any other circle here
+	bool is_clear(const sf::Vector2f point, const float radius) const
+	{
+		return !grid.any_near(point, radius + grid.max_radius(), [&](const size_t i)
+		{
+			return distance_between(circles.position(i), point) < circles.radius(i) + radius;
+		});
 	}
 
-	void process_mouse_state()
+	void spawn_circle(const sf::Vector2f spawn_point)
 	{
+		const float radius = random_float_from(rng, detail::circle_radius_min, detail::circle_radius_max);
+		circles.add(spawn_point, radius, color_for_radius(radius));
 
+		// later spawns this tick must see this circle too
+		grid.insert(circles.size() - 1, spawn_point, radius);
 	}
 
-	void apply_gravity()
+	void spawn_circles()
 	{
-		for (auto& circle : circles)
+		// each emitter lays its burst out in a row, centered on itself
+		for (const auto& emitter : emitters)
 		{
-			circle.accelerate(detail::gravity);
+			for (size_t k = 0; k < emitter.burst; ++k)
+			{
+				const float offset = (k - (emitter.burst - 1) / 2.f) * detail::circle_radius_max * 2.f;
+				const sf::Vector2f spawn_point = emitter.position + sf::Vector2f{ offset, 0.f };
+
+				// make sure a circle of any size could spawn here
+				if (is_clear(spawn_point, detail::circle_radius_max))
+				{
+					spawn_circle(spawn_point);
+				}
+			}
 		}
 	}
 
-	void update_positions(float dt)
+	/*
+	Places up to `count` circles in the region at once, on a hexagonal lattice spaced for the largest
+	radius. Each circle gets a random radius and is jittered within its lattice site, so no two can
+	overlap; sites that would overlap an existing circle are skipped. Rows are generated in parallel,
+	each from its own random stream, so the result is the same for any number of threads.
+	*/
+	void prefill(const size_t count, const sf::FloatRect region, const float radius_min, const float radius_max)
 	{
-		for (auto& circle : circles)
+		const float spacing = radius_max * 2.f;
+		const float row_height = spacing * sqrt(3.f) / 2.f;
+
+		const size_t cols = size_t(std::max(0.f, (region.width - radius_max) / spacing));
+		const size_t rows = size_t(std::max(0.f, (region.height - spacing) / row_height) + 1.f);
+		const size_t sites = std::min(count, cols * rows);
+		if (sites == 0) return;
+
+		std::vector<sf::Vector2f> positions(sites);
+		std::vector<float> radii(sites);
+		std::vector<uint8_t> accepted(sites);
+		const uint64_t seed = rng.next();
+
+		parallel_for((sites + cols - 1) / cols, [&](const size_t row)
 		{
-			circle.update_position(dt);
+			pcg32 row_rng{ seed, row };
+			const float row_offset = (row % 2) ? radius_max : 0.f;
+
+			for (size_t col = 0; col < cols && row * cols + col < sites; ++col)
+			{
+				const size_t site = row * cols + col;
+				const float radius = random_float_from(row_rng, radius_min, radius_max);
+				const float slack = (radius_max - radius) * (float)M_SQRT1_2;
+
+				positions[site] = {
+					region.left + radius_max + col * spacing + row_offset + random_float_from(row_rng, -slack, slack),
+					region.top + radius_max + row * row_height + random_float_from(row_rng, -slack, slack) };
+				radii[site] = radius;
+				accepted[site] = is_clear(positions[site], radius);
+			}
+		}, 1);
+
+		// keep the accepted sites, in order
+		std::vector<size_t> kept;
+		for (size_t site = 0; site < sites; ++site)
+		{
+			if (accepted[site]) kept.push_back(site);
 		}
+
+		const size_t first = circles.grow(kept.size());
+
+		parallel_for(kept.size(), [&](const size_t k)
+		{
+			const size_t i = first + k;
+			circles.set_position(i, positions[kept[k]]);
+			circles.reset_velocity(i);
+			circles.radii[i] = radii[kept[k]];
+			circles.colors[i] = color_for_radius(radii[kept[k]]);
+		});
+
+		grid.build(circles);
 	}
 
-	void apply_constraint(sf::CircleShape& sf_circle)
+	// Applies the current tool to the circles within reach of the mouse. Only the grid cells in reach
+	// are visited, so the cost depends on how many circles are affected, not on how many there are.
+	void process_mouse_state()
 	{
-		const sf::Vector2f center{ detail::window_width / 2.f, detail::window_height / 2.f };
-		const float center_radius = 300.f;
+		const bool active = (tool == mouse_tool::explode) ? explosion_pending : (lmb_pressed && tool != mouse_tool::barriers);
+		explosion_pending = false;
+		if (!active) return;
 
-		const sf::Vector2f to_center = sf_circle.getPosition() - center;
-		const float distance = distance_between(sf_circle.getPosition(), center);
+		const float reach = detail::tool_radius;
 
-		// if the circle is out of bounds
-		if (distance > center_radius - sf_circle.getRadius())
+		grid.for_each_near(mouse_pos, reach, [&](const size_t i)
 		{
-			const sf::Vector2f n = to_center / distance;
-			sf_circle.setPosition(center + n * (center_radius - sf_circle.getRadius()));
-		}
-	}
+			const sf::Vector2f offset = circles.position(i) - mouse_pos;
+			const float distance = sqrt(dot(offset, offset));
+			if (distance >= reach) return;
 
-	void apply_constraints()
-	{
-		//for (auto& circle : circles)
-		//{
-		//	apply_constraint(circle.sf_circle);
-		//}
+			// full strength at the mouse, fading to nothing at the edge
+			const float falloff = 1.f - distance / reach;
+			const sf::Vector2f away = (distance > 0.f) ? offset / distance : sf::Vector2f{ 0.f, 0.f };
+
+			switch (tool)
+			{
+				case mouse_tool::attract: circles.accelerate(i, -away * detail::tool_acceleration * falloff); break;
+				case mouse_tool::repel: circles.accelerate(i, away * detail::tool_acceleration * falloff); break;
+				case mouse_tool::explode: circles.set_velocity(i, circles.velocity(i) + away * detail::explosion_speed * detail::time_step * falloff); break;
+				case mouse_tool::erase: circles.remove(i); break; // compacted with the fallen circles, later this tick
+				default: break;
+			}
+		});
 	}
 
 	void clear_fallen_circles()
 	{
-		for (auto it = circles.cbegin(); it != circles.cend(); )
+		for (size_t i = 0; i < circles.size(); ++i)
 		{
-			if (it->position().y > detail::window_height + detail::circle_radius_max + 100.f)
-			{
-				it = circles.erase(it);
-			}
-			else
+			// written so that NaN positions are deleted too
+			if (!(std::abs(circles.x[i]) <= detail::world_extent && std::abs(circles.y[i]) <= detail::world_extent))
 			{
-				++it;
+				circles.remove(i);
 			}
 		}
+
+		circles.compact();
 	}
 
-	void resolve_circle_to_circle_collision(circle& c1, circle& c2)
+	// Returns how deeply circles i and j overlap. If they do, `correction` is set to how far i must move to resolve it.
+	float get_collision_correction(const size_t i, const size_t j, sf::Vector2f& correction) const
 	{
-		const sf::Vector2f collision_axis = c1.position() - c2.position();
-		const float distance = distance_between(c1.position(), c2.position());
-		const float radii = c1.radius() + c2.radius();
+		const sf::Vector2f collision_axis = circles.position(i) - circles.position(j);
+		const float distance = distance_between(circles.position(i), circles.position(j));
+		const float radii = circles.radius(i) + circles.radius(j);
 
 		// if the circles are overlapping
 		if (distance < radii)
 		{
 			const sf::Vector2f n = collision_axis / distance;
 			const float delta = radii - distance;
-			c1.sf_circle.setPosition(c1.position() + detail::repulsion_force * delta * n);
-			c2.sf_circle.setPosition(c2.position() - detail::repulsion_force * delta * n);
+			correction = detail::repulsion_force * delta * n;
+			return delta;
 		}
+
+		return 0.f;
 	}
 
-	bool resolve_circle_to_rigid_circle_collision(circle& c1, const circle& c2)
+	// Returns how deeply the circles overlapped
+	float resolve_circle_to_circle_collision(const size_t i, const size_t j)
 	{
-		const sf::Vector2f collision_axis = c1.position() - c2.position();
-		const float distance = distance_between(c1.position(), c2.position());
-		const float radii = c1.radius() + c2.radius();
+		sf::Vector2f correction;
+		const float delta = get_collision_correction(i, j, correction);
+
+		if (delta > 0.f)
+		{
+			circles.move(i, correction);
+			circles.move(j, -correction);
+		}
+
+		return delta;
+	}
+
+	// Returns how deeply the circles overlapped, or 0 if there was no collision
+	float resolve_circle_to_rigid_circle_collision(const size_t i, const sf::Vector2f center, const float radius)
+	{
+		const sf::Vector2f collision_axis = circles.position(i) - center;
+		const float distance = distance_between(circles.position(i), center);
+		const float radii = circles.radius(i) + radius;
 
 		// if the circles are overlapping
 		if (distance < radii)
 		{
 			const sf::Vector2f n = collision_axis / distance;
 			const float delta = radii - distance;
-			c1.sf_circle.setPosition(c1.position() + detail::repulsion_force * delta * n);
+			circles.move(i, detail::repulsion_force * delta * n);
 
-			return true;
+			return delta;
 		}
 
-		return false;
+		return 0.f;
 	}
 
-	// Returns true if there was a collision; otherwise false
-	bool resolve_circle_to_point_collision(circle& c, const sf::Vector2f& p)
+	// Returns how deeply the circle overlapped the point, or 0 if there was no collision
+	float resolve_circle_to_point_collision(const size_t i, const sf::Vector2f& p)
 	{
-		const sf::Vector2f collision_axis = c.position() - p;
-		const float distance = distance_between(c.position(), p);
+		const sf::Vector2f collision_axis = circles.position(i) - p;
+		const float distance = distance_between(circles.position(i), p);
 
 		// if the circle overlaps the point
-		if (distance < c.radius())
+		if (distance < circles.radius(i))
 		{
 			const sf::Vector2f n = collision_axis / distance;
-			const float delta = c.radius() - distance;
-			c.sf_circle.setPosition(c.position() + detail::repulsion_force * delta * n);
+			const float delta = circles.radius(i) - distance;
+			circles.move(i, detail::repulsion_force * delta * n);
 
-			return true;
+			return delta;
 		}
 
-		return false;
+		return 0.f;
 	}
 
-	void resolve_collisions()
+	float resolve_circle_collisions_gauss_seidel()
 	{
+		float max_penetration = 0.f;
+
+		// each pair once, from its lower index, and in index order, as the all-pairs loop would
 		for (size_t i = 0; i < circles.size(); ++i)
 		{
-			for (size_t j = i + 1; j < circles.size(); ++j)
+			neighbors.clear();
+			grid.for_each_near(circles.position(i), circles.radius(i) + grid.max_radius(), [&](const size_t j)
+			{
+				if (j > i) neighbors.push_back((uint32_t)j);
+			});
+			std::sort(neighbors.begin(), neighbors.end());
+
+			for (const uint32_t j : neighbors)
 			{
-				resolve_circle_to_circle_collision(circles[i], circles[j]);
+				max_penetration = std::max(max_penetration, resolve_circle_to_circle_collision(i, j));
 			}
 		}
 
-		for (auto& circle : circles)
+		return max_penetration;
+	}
+
+	float resolve_circle_collisions_jacobi()
+	{
+		/*
+		Each circle gathers the corrections from all of its contacts, always in grid order, and
+		only writes to its own slot. The sums are therefore bit-identical no matter how the work
+		is split across threads. All corrections are applied afterwards in a second pass.
+		*/
+		corrections.resize(circles.size());
+
+		const float max_penetration = parallel_max(circles.size(), [&](const size_t i)
 		{
-			for (auto& barrier : barriers)
+			sf::Vector2f correction;
+			float max = 0.f;
+
+			grid.for_each_near(circles.position(i), circles.radius(i) + grid.max_radius(), [&](const size_t j)
 			{
-				float w = barrier.get_size().x;
-				float h = barrier.get_size().y;
+				if (j != i)
+				{
+					sf::Vector2f pair_correction;
+					max = std::max(max, get_collision_correction(i, j, pair_correction));
+					correction += pair_correction;
+				}
+			});
+
+			corrections[i] = correction;
+			return max;
+		});
+
+		parallel_for(circles.size(), [&](const size_t i)
+		{
+			circles.move(i, corrections[i]);
+		});
 
-				const auto transform = barrier.get_transform();
-				sf::Vector2f a = transform.transformPoint(0.f, 0.f);
-				sf::Vector2f b = transform.transformPoint(w, 0.f);
-				sf::Vector2f c = transform.transformPoint(0.f, h);
-				sf::Vector2f d = transform.transformPoint(w, h);
+		return max_penetration;
+	}
 
-				const auto side_1 = get_closest_point(a, b, circle.position());
-				const auto side_2 = get_closest_point(c, d, circle.position());
+	float resolve_circle_collisions_colored()
+	{
+		/*
+		No circle appears twice within a color, so each color is resolved in parallel, in place. Colors
+		are visited in order, so every contact still sees the corrections made by earlier colors.
+		*/
+		float max_penetration = 0.f;
 
-				// Only do collision against the rounded end caps of a barrier if a circle did not interact with the length of the barrier
-				if (resolve_circle_to_point_collision(circle, side_1)) continue;
+		for (size_t color = 0; color < contacts.color_count(); ++color)
+		{
+			const contact* batch = contacts.begin_of(color);
+			const auto resolve = [&](const size_t i)
+			{
+				return resolve_circle_to_circle_collision(batch[i].a, batch[i].b);
+			};
 
-				if (resolve_circle_to_point_collision(circle, side_2)) continue;
+			if (contacts.is_overflow(color))
+			{
+				for (size_t i = 0; i < contacts.size_of(color); ++i)
+				{
+					max_penetration = std::max(max_penetration, resolve(i));
+				}
+			}
+			else
+			{
+				max_penetration = std::max(max_penetration, parallel_max(contacts.size_of(color), resolve, 256));
+			}
+		}
 
-				if (resolve_circle_to_rigid_circle_collision(circle, barrier.get_end_1())) continue;
+		return max_penetration;
+	}
 
-				if (resolve_circle_to_rigid_circle_collision(circle, barrier.get_end_2())) continue; // this doesn't need to be in an "if"
-			}
+	float resolve_barrier_collisions(const size_t i)
+	{
+		float max_penetration = 0.f;
+
+		const sf::Vector2f extent{ circles.radius(i), circles.radius(i) };
+		barrier_index.for_each_near(circles.position(i) - extent, circles.position(i) + extent, [&](const size_t k)
+		{
+			const barrier& barrier = barriers[k];
+			const auto& [a, b, c, d] = barrier.get_corners();
+
+			const auto side_1 = get_closest_point(a, b, circles.position(i));
+			const auto side_2 = get_closest_point(c, d, circles.position(i));
+
+			// Only do collision against the rounded end caps of a barrier if a circle did not interact with the length of the barrier
+			float delta = resolve_circle_to_point_collision(i, side_1);
+			if (delta == 0.f) delta = resolve_circle_to_point_collision(i, side_2);
+			if (delta == 0.f) delta = resolve_circle_to_rigid_circle_collision(i, barrier.get_a(), barrier.get_radius());
+			if (delta == 0.f) delta = resolve_circle_to_rigid_circle_collision(i, barrier.get_b(), barrier.get_radius());
+
+			max_penetration = std::max(max_penetration, delta);
+		});
+
+		return max_penetration;
+	}
+
+	// Returns the deepest overlap that this pass resolved
+	float resolve_collisions()
+	{
+		float max_penetration = 0.f;
+
+		switch (solver)
+		{
+			case solver_mode::gauss_seidel: max_penetration = resolve_circle_collisions_gauss_seidel(); break;
+			case solver_mode::jacobi: max_penetration = resolve_circle_collisions_jacobi(); break;
+			case solver_mode::colored: max_penetration = resolve_circle_collisions_colored(); break;
 		}
+
+		// barriers are static, so each circle can be resolved against them independently
+		return std::max(max_penetration, parallel_max(circles.size(), [&](const size_t i)
+		{
+			return resolve_barrier_collisions(i);
+		}));
+	}
+
+	void sweep_fast_circles()
+	{
+		/*
+		A circle that moves more than a fraction of the thinnest barrier's thickness in one step can pass
+		straight through it. Sweep those circles from where they were to where they are now, and stop them
+		at the first barrier they would have hit.
+		*/
+		if (barriers.empty()) return;
+
+		const float threshold = detail::ccd_threshold * barrier_index.min_thickness();
+
+		parallel_for(circles.size(), [&](const size_t i)
+		{
+			const sf::Vector2f velocity = circles.velocity(i);
+
+			if (dot(velocity, velocity) <= threshold * threshold) return;
+
+			const sf::Vector2f start = circles.position(i) - velocity;
+			const barrier* first_hit = nullptr;
+			float first_t = 2.f;
+
+			const sf::Vector2f end = circles.position(i);
+			const sf::Vector2f extent{ circles.radius(i), circles.radius(i) };
+			const sf::Vector2f min{ std::min(start.x, end.x), std::min(start.y, end.y) };
+			const sf::Vector2f max{ std::max(start.x, end.x), std::max(start.y, end.y) };
+
+			barrier_index.for_each_near(min - extent, max + extent, [&](const size_t k)
+			{
+				const barrier& barrier = barriers[k];
+
+				float t;
+				if (sweep_point_against_capsule(start, velocity, barrier.get_a(), barrier.get_b(),
+					barrier.get_radius() + circles.radius(i), t) && (t < first_t || (t == first_t && &barrier < first_hit)))
+				{
+					first_hit = &barrier;
+					first_t = t;
+				}
+			});
+
+			if (first_hit == nullptr) return;
+
+			// stop at the point of contact, and drop the part of the velocity heading into the barrier
+			const sf::Vector2f contact = start + velocity * first_t;
+			const sf::Vector2f closest = get_closest_point(first_hit->get_a(), first_hit->get_b(), contact);
+			const sf::Vector2f n = (contact - closest) / distance_between(contact, closest);
+
+			circles.set_position(i, contact);
+			circles.set_velocity(i, velocity - n * std::min(0.f, dot(velocity, n)));
+		});
 	}
 
 	void tick_physics()
 	{
-		apply_gravity();
-		resolve_collisions();
-		update_positions(detail::time_step);
+		// contacts are found once per tick, and reused by every iteration
+		if (solver == solver_mode::colored)
+		{
+			contacts.build(circles, grid);
+		}
+
+		// iterate until the pile is (nearly) separated, or we run out of iterations
+		solver_iterations_used = 0;
+		while (solver_iterations_used < solver_iterations)
+		{
+			++solver_iterations_used;
+			const float max_penetration = resolve_collisions();
+			bounds.apply(circles);
+			if (max_penetration < detail::penetration_tolerance) break;
+		}
+
+		// with mutual gravitation, circles pull on each other instead of falling
+		if (mutual_gravity)
+		{
+			gravity_tree.build(circles);
+			gravity_tree.apply(circles, theta);
+		}
+
+		// one streaming pass over every circle, whatever the field looks like
+		if (field != field_kind::none)
+		{
+			force.apply(circles);
+		}
+
+		// gravity, integration, and clearing the accumulated acceleration, in one pass
+		circles.update_positions(mutual_gravity ? sf::Vector2f{ 0.f, 0.f } : detail::gravity, detail::time_step);
+		sweep_fast_circles();
 	}
 
 	void tick()
@@ -406,49 +1164,313 @@ private:
 		event handling or rendering.
 		*/
 		++tick_counter;
+		recorder.on_tick();
 
+		// the grid, current since the end of the last tick, is shared by the mouse tools, spawning,
+		// and every solver iteration this tick
 		process_mouse_state();
-		try_spawn_circle();
+
+		spawn_circles();
 		tick_physics();
 		clear_fallen_circles();
 
+		// and by rendering, until the next tick
+		grid.build(circles);
+
+		exporter.capture(tick_counter, circles);
+
+		if (checkpointing && tick_counter % detail::checkpoint_interval == 0)
+		{
+			// only the copy happens here; serializing and flushing happen on the checkpointer's thread
+			const auto start = current_time_in_us();
+			if (checkpoints.capture([&](world_state& state) { capture_state(state); }))
+			{
+				checkpoint_capture_ms = (current_time_in_us() - start) / 1000.f;
+			}
+		}
+
+		if (rewinding) rewind.record(tick_counter, circles);
+	}
+
+	void update_overlay()
+	{
 		std::stringstream ss;
-		ss << "Create barrier: left mouse button    Cancel/erase: right mouse button    Erase all circles: ctrl + c \n\n";
+		ss << "Create barrier: left mouse button    Cancel/erase: right mouse button    Erase all circles: ctrl + c \n";
+		ss << "Cycle solver: s    Solver iterations: [ and ]    Add emitter: e    Remove emitters: ctrl + e    Prefill: p \n";
+		ss << "Save snapshot: f5    Load snapshot: f9    Export trajectories: x    Periodic checkpoints: k \n";
+		ss << "Export barriers: f6 (shift: binary)    Import barriers: f7 (shift: binary) \n";
+		ss << "Pause: space    Rewind while paused: left and right (shift: 1 second)    Rewind history: r    Cycle mouse tool: t \n";
+		ss << "Mutual gravitation: g    Barnes-Hut opening angle: , and .    Cycle force field: f (shift: load)    Cycle world bounds: b \n";
+		ss << "Pan: middle mouse button    Zoom: mouse wheel    Reset view: home    Cycle heatmap: h \n\n";
 		ss << mouse_pos.x << ", " << mouse_pos.y << "\n\n";
 		ss << "Barriers: " << barriers.size() << '\n';
-		ss << "Circles: " << circles.size() << '\n';
+		ss << "Circles: " << circles.size() << " in " << grid.occupied_cells() << " grid cells\n";
+		ss << "Emitters: " << emitters.size() << '\n';
+		ss << "Mouse tool: " << tool_name() << '\n';
+		if (mutual_gravity)
+		{
+			ss << "Mutual gravitation: theta " << theta << ", " << gravity_tree.node_count() << " nodes\n";
+		}
+		if (field != field_kind::none)
+		{
+			ss << "Force field: " << field_name() << '\n';
+		}
+		ss << "World bounds: " << bounds_name() << '\n';
+		if (heat != heatmap_mode::off)
+		{
+			ss << "Heatmap: " << (heat == heatmap_mode::density ? "density" : "speed") << '\n';
+		}
+		else if (circle_vertices.shown_circles > 0)
+		{
+			// circles at rest cost nothing, so a settled pile uploads only what moves
+			ss << "Uploaded: " << circle_vertices.uploaded_circles << " of " << circle_vertices.shown_circles
+				<< " visible circles, in " << circle_vertices.upload_ranges << " ranges\n";
+		}
+		ss << "Solver: " << solver_name() << '\n';
+		ss << "Solver iterations: " << solver_iterations_used << " of " << solver_iterations << '\n';
+		if (exporter.is_running())
+		{
+			ss << "Exporting: " << exporter.frames_written << " frames, " << exporter.bytes_written / (1024 * 1024) << " MB, "
+				<< exporter.frames_dropped << " dropped" << (exporter.write_failed ? " (write failed)" : "");
+			ss << '\n';
+		}
+		if (checkpointing && !checkpoints.is_busy())
+		{
+			ss << "Checkpoints: " << checkpoints.checkpoints_written << " written, last took " << checkpoint_capture_ms
+				<< " ms on the tick thread and " << checkpoints.last_write_ms << " ms to write"
+				<< (checkpoints.last_write_ok ? "" : " (failed)") << '\n';
+		}
+		if (!rewind.empty())
+		{
+			ss << "Rewind: " << (rewind.newest_tick() - rewind.oldest_tick() + 1) / detail::framerate << " s retained, "
+				<< rewind.memory_used() / (1024 * 1024) << " MB\n";
+		}
+		if (paused)
+		{
+			ss << "Paused";
+			if (!rewind.empty()) ss << ", showing tick " << rewind_tick << " (" << tick_counter - rewind_tick << " back)";
+			ss << '\n';
+		}
+		ss << status << '\n';
 		overlay.setString(ss.str());
 	}
 
+	const char* tool_name() const
+	{
+		switch (tool)
+		{
+			case mouse_tool::attract: return "attract";
+			case mouse_tool::repel: return "repel";
+			case mouse_tool::explode: return "explode";
+			case mouse_tool::erase: return "erase circles";
+			default: return "draw barriers";
+		}
+	}
+
+	const char* bounds_name() const
+	{
+		switch (bounds.get_shape())
+		{
+			case bounds_shape::box: return "box";
+			case bounds_shape::circle: return "circle";
+			case bounds_shape::sampled: return "hourglass";
+			default: return "none";
+		}
+	}
+
+	const char* field_name() const
+	{
+		switch (field)
+		{
+			case field_kind::wind: return "wind";
+			case field_kind::whirlpool: return "whirlpool";
+			case field_kind::loaded: return detail::force_field_path;
+			default: return "none";
+		}
+	}
+
+	const char* solver_name() const
+	{
+		switch (solver)
+		{
+			case solver_mode::jacobi: return "Jacobi";
+			case solver_mode::colored: return "colored Gauss-Seidel";
+			default: return "Gauss-Seidel";
+		}
+	}
+
+	void draw_barrier(const barrier& barrier, const sf::Color color)
+	{
+		const sf::Vector2f ab = barrier.get_b() - barrier.get_a();
+
+		barrier_body.setPosition(barrier.get_a());
+		barrier_body.setRotation(atan2(ab.y, ab.x) * 180.f / (float)M_PI);
+		barrier_body.setScale(barrier.get_length(), barrier.get_thickness());
+		barrier_body.setFillColor(color);
+		window->draw(barrier_body);
+
+		barrier_cap.setScale(barrier.get_radius(), barrier.get_radius());
+		barrier_cap.setPosition(barrier.get_a());
+		window->draw(barrier_cap);
+		barrier_cap.setPosition(barrier.get_b());
+		window->draw(barrier_cap);
+	}
+
 	void render()
 	{
 		window->clear(detail::background);
+		window->setView(camera);
 
-		for (auto& circle : circles)
+		// only what the camera can see is drawn
+		const sf::Vector2f view_min = camera.getCenter() - camera.getSize() / 2.f;
+		const sf::Vector2f view_max = camera.getCenter() + camera.getSize() / 2.f;
+		const auto is_visible = [&](const sf::Vector2f min, const sf::Vector2f max)
 		{
-			window->draw(circle.sf_circle);
-		}
+			return max.x >= view_min.x && min.x <= view_max.x && max.y >= view_min.y && min.y <= view_max.y;
+		};
 
-		for (auto& barrier : barriers)
+		// while paused, show the tick being scrubbed to
+		const circle_store& shown = paused && !rewind.empty() ? rewound : circles;
+
+		if (heat != heatmap_mode::off)
 		{
-			barrier.draw(*window);
+			// one texture instead of a shape per circle, drawn over the whole window
+			heat_map.update(shown, view_min, camera.getSize(), heat);
+			window->setView(window->getDefaultView());
+			window->draw(heat_map.get_sprite(window->getDefaultView().getSize()));
+			window->setView(camera);
 		}
+		else
+		{
+			visible.clear();
+			const auto gather = [&](const size_t i)
+			{
+				const sf::Vector2f extent{ shown.radius(i), shown.radius(i) };
+				if (is_visible(shown.position(i) - extent, shown.position(i) + extent)) visible.push_back((uint32_t)i);
+			};
+
+			// the grid only visits the cells in view; a circle can reach into the view from a cell outside it
+			if (&shown == &circles)
+			{
+				const sf::Vector2f reach{ grid.max_radius(), grid.max_radius() };
+				grid.for_each_in(view_min - reach, view_max + reach, gather);
+			}
+			else
+			{
+				// a rewound tick has no grid of its own
+				for (size_t i = 0; i < shown.size(); ++i) gather(i);
+			}
+
+			if (sf::VertexBuffer::isAvailable())
+			{
+				// one draw call, and only the visible circles whose quads changed are uploaded; `visible` can be
+				// in any order, since each circle's quad is kept at its slot
+				circle_vertices.update(shown, visible);
+				window->draw(circle_vertices);
+			}
+			else
+			{
+				for (const uint32_t i : visible)
+				{
+					circle_shape.setPosition(shown.position(i));
+					circle_shape.setScale(shown.radius(i), shown.radius(i));
+					circle_shape.setFillColor(shown.colors[i]);
+					window->draw(circle_shape);
+				}
+			}
+		}
+
+		// highlight the barrier a right click would erase
+		const size_t hovered = drawing_barrier ? SIZE_MAX : barrier_at(mouse_pos);
+		barrier_index.for_each_near(view_min, view_max, [&](const size_t k)
+		{
+			if (!is_visible(barriers[k].get_min(), barriers[k].get_max())) return;
+			draw_barrier(barriers[k], (k == hovered) ? detail::hovered_barrier_color : barriers[k].get_color());
+		});
 
 		if (drawing_barrier)
 		{
-			new_barrier.draw(*window);
+			draw_barrier(new_barrier, new_barrier.get_color());
 		}
 
+		if (tool != mouse_tool::barriers)
+		{
+			tool_outline.setPosition(mouse_pos);
+			window->draw(tool_outline);
+		}
+
+		// the overlay stays put on the screen
+		window->setView(window->getDefaultView());
 		window->draw(overlay);
 	}
 
 public:
+	// Replaces every barrier with the layout in the given file (text or binary), or keeps them all if it can't be read
+	bool load_barriers_from(const std::string& path)
+	{
+		const auto start = current_time_in_us();
+
+		if (!load_barriers(barriers, path))
+		{
+			status = "Could not import barriers from " + path + ", kept the current " + std::to_string(barriers.size());
+			return false;
+		}
+		barrier_index.build(barriers);
+
+		std::stringstream ss;
+		ss << "Imported " << barriers.size() << " barriers from " << path << " in "
+			<< (current_time_in_us() - start) / 1000.f << " ms";
+		status = ss.str();
+		return true;
+	}
+
+	// Records every input from now on, so that the session can be replayed
+	bool record_to(const std::string& path)
+	{
+		rng.set_seed(detail::random_seed);
+		return recorder.open(path, detail::random_seed);
+	}
+
+	// Re-runs a recorded session without rendering, as fast as possible, and reports how long it took
+	bool replay(const std::string& path)
+	{
+		recording session;
+		if (!load_recording(session, path))
+		{
+			std::cout << "Could not load recording " << path << '\n';
+			return false;
+		}
+
+		rng.set_seed(session.seed);
+
+		const auto start = current_time_in_us();
+
+		size_t next_action = 0;
+		for (uint32_t t = 0; t < session.tick_count; ++t)
+		{
+			while (next_action < session.actions.size() && session.actions[next_action].tick <= t)
+			{
+				apply_input(session.actions[next_action++]);
+			}
+
+			tick();
+		}
+
+		const auto elapsed_us = current_time_in_us() - start;
+
+		std::cout << "Replayed " << session.tick_count << " ticks and " << session.actions.size() << " inputs in "
+			<< elapsed_us / 1000.f << " ms (" << (session.tick_count ? elapsed_us / 1000.f / session.tick_count : 0.f)
+			<< " ms per tick), ending with " << circles.size() << " circles\n";
+		return true;
+	}
+
 	void run()
 	{
 		while (window->isOpen())
 		{
 			handle_events();
-			tick();
+			if (!paused) tick();
+			update_overlay();
 			render();
 
 			window->display();
@@ -462,17 +1484,76 @@ private:
 	bool rmb_pressed = false;
 
 	sf::Vector2f mouse_pos{ 0, 0 };
+	sf::Vector2f previous_mouse_pos{ 0, 0 };
 	sf::Vector2f mouse_clicked_pos{ 0, 0 };
 
 	sf::CircleShape pointer_click_helper;
 
+	mouse_tool tool = mouse_tool::barriers;
+	bool explosion_pending = false;
+	sf::CircleShape tool_outline;
+
 	barrier new_barrier;
 	std::vector<barrier> barriers;
+	barrier_grid barrier_index; // rebuilt whenever barriers are added
+	std::vector<size_t> erased;
 	bool drawing_barrier = false;
 
 	std::unique_ptr<sf::RenderWindow> window;
+	sf::View camera;
+	bool panning = false;
+	sf::Vector2i pan_from; // the pixel the mouse was at when the camera last moved
+
+	heatmap_mode heat = heatmap_mode::off;
+	std::vector<uint32_t> visible; // the circles in view, this frame
+	circle_vertex_buffer circle_vertices;
+	heatmap heat_map{ (size_t)detail::window_width / detail::heatmap_texel_size, (size_t)detail::window_height / detail::heatmap_texel_size };
+	std::string status; // the result of the last save or load
+
+	input_recorder recorder;
+	trajectory_exporter exporter;
+
+	checkpointer checkpoints{ detail::checkpoint_path };
+	bool checkpointing = false;
+	float checkpoint_capture_ms = 0.f;
+
+	bool rewinding = true; // recording rewind history every tick
+	rewind_buffer rewind{ detail::rewind_region };
+	circle_store rewound; // the circles as of rewind_tick
+	uint64_t rewind_tick = 0;
+	bool paused = false;
+
 	sf::Font arial;
 	sf::Text overlay;
 
-	std::vector<circle> circles;
+	struct emitter
+	{
+		sf::Vector2f position;
+		size_t burst; // circles per tick
+	};
+
+	pcg32 rng{ detail::random_seed }; // for anything that must be reproducible, such as spawning
+
+	circle_store circles;
+	std::vector<emitter> emitters{ { { detail::window_width * .6f, 50.f }, 1 } };
+	sf::CircleShape circle_shape;
+	sf::RectangleShape barrier_body;
+	sf::CircleShape barrier_cap;
+
+	solver_mode solver = solver_mode::gauss_seidel;
+	size_t solver_iterations = detail::solver_iterations;
+	std::vector<uint32_t> neighbors; // of one circle, during a Gauss-Seidel pass
+	size_t solver_iterations_used = 0;
+	spatial_grid grid;
+	std::vector<sf::Vector2f> corrections;
+	contact_graph contacts;
+
+	bool mutual_gravity = false;
+	float theta = detail::barnes_hut_theta;
+	barnes_hut_tree gravity_tree;
+
+	field_kind field = field_kind::none;
+	force_field force;
+
+	world_bounds bounds;
 };
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+enum class input_type : uint8_t
+{
+	mouse_moved,
+	lmb_pressed,
+	lmb_released,
+	rmb_pressed,
+	rmb_released,
+	key_pressed
+};
+
+// One user input, applied just before the given tick
+struct input_action
+{
+	uint32_t tick;
+	input_type type;
+	uint8_t key; // sf::Keyboard::Key, for key presses
+	uint8_t modifiers; // see the modifier_* flags
+	uint8_t unused;
+	sf::Vector2f position; // the mouse position, in world coordinates
+};
+
+const uint8_t modifier_control = 1u << 0;
+const uint8_t modifier_shift = 1u << 1;
+const uint8_t modifier_alt = 1u << 2;
+
+/*
+A recording is a fixed header followed by every input action, in order, as fixed-size records.
+The header holds the seed the session started from, and how many ticks the session ran for.
+*/
+namespace recording_format
+{
+	const char magic[8] = { 'P', 'H', 'Y', 'S', 'R', 'E', 'C', '\0' };
+	const uint32_t version = 1;
+
+	struct header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t tick_count;
+		uint64_t seed;
+	};
+
+	static_assert(sizeof(input_action) == 16, "input actions are stored as 16 bytes");
+}
+
+struct recording
+{
+	uint64_t seed = 0;
+	uint32_t tick_count = 0;
+	std::vector<input_action> actions;
+};
+
+class input_recorder
+{
+public:
+	~input_recorder() { close(); }
+
+	bool open(const std::string& path, const uint64_t seed)
+	{
+		close();
+
+		file = std::fopen(path.c_str(), "wb");
+		if (file == nullptr) return false;
+
+		header = {};
+		std::memcpy(header.magic, recording_format::magic, sizeof(header.magic));
+		header.version = recording_format::version;
+		header.seed = seed;
+
+		return write_header();
+	}
+
+	bool is_open() const { return file != nullptr; }
+
+	void record(const input_action& action)
+	{
+		if (file != nullptr) std::fwrite(&action, sizeof(action), 1, file);
+	}
+
+	void on_tick() { ++header.tick_count; }
+
+	// actions should be stamped with this
+	uint32_t tick() const { return header.tick_count; }
+
+	void close()
+	{
+		if (file == nullptr) return;
+
+		// now that the length of the session is known, write the header again
+		std::fseek(file, 0, SEEK_SET);
+		write_header();
+		std::fclose(file);
+		file = nullptr;
+	}
+
+private:
+	bool write_header() { return std::fwrite(&header, sizeof(header), 1, file) == 1; }
+
+	std::FILE* file = nullptr;
+	recording_format::header header{};
+};
+
+bool load_recording(recording& out, const std::string& path)
+{
+	std::FILE* file = std::fopen(path.c_str(), "rb");
+	if (file == nullptr) return false;
+
+	recording_format::header header;
+	bool ok = std::fread(&header, sizeof(header), 1, file) == 1
+		&& std::memcmp(header.magic, recording_format::magic, sizeof(header.magic)) == 0
+		&& header.version == recording_format::version;
+
+	if (ok)
+	{
+		out.seed = header.seed;
+		out.tick_count = header.tick_count;
+		out.actions.clear();
+
+		input_action action;
+		while (std::fread(&action, sizeof(action), 1, file) == 1)
+		{
+			out.actions.push_back(action);
+		}
+	}
+
+	std::fclose(file);
+	return ok;
+}
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#include "detail.hpp"
+#include "circle.hpp"
+#include "codec.hpp"
+
+/*
+Keeps the last few seconds of circle positions, within a fixed memory budget, so that they can be
+scrubbed through. Every tick is stored as a frame of quantized deltas against the previous tick;
+every detail::rewind_keyframe_interval ticks, a keyframe starts over from nothing, so that any
+retained tick can be rebuilt by decoding at most that many frames. When the budget is exceeded,
+the oldest keyframe and its deltas are dropped together.
+
+Frame layout:
+	varint circle count, then one byte: 1 if the circles (or their order) changed since the last frame
+	if they changed, per circle: varint (zigzag(slot - previous slot) << 1 | is_new),
+		followed by the radius (a float) and the color (four bytes) if is_new
+	then the moved circles, as runs: varint count of circles that didn't move, then varint zigzag(dx),
+		varint zigzag(dy) for the next circle, until every circle is accounted for
+Deltas are in quantized units, against the same circle's position in the previous frame (or against
+0, 0 if the circle is new). Circles outside detail::rewind_region are kept at the same precision, in
+longer deltas.
+*/
+class rewind_buffer
+{
+public:
+	explicit rewind_buffer(const sf::FloatRect region) : quantize(region) {}
+
+	// Call once per tick, with consecutive ticks
+	void record(const uint64_t tick, const circle_store& circles)
+	{
+		if (!frames.empty() && tick != newest_tick() + 1) clear();
+
+		frame f;
+		if (!spare.empty())
+		{
+			f = std::move(spare.back());
+			spare.pop_back();
+		}
+
+		f.tick = tick;
+		f.keyframe = tick % detail::rewind_keyframe_interval == 0 || frames.empty();
+		if (f.keyframe) encoded.reset();
+
+		encode(circles, encoded, f.bytes);
+
+		bytes_used += f.bytes.capacity();
+		keyframes += f.keyframe;
+		frames.push_back(std::move(f));
+
+		while (bytes_used > detail::rewind_budget && keyframes > 1)
+		{
+			drop_oldest_keyframe();
+		}
+	}
+
+	void clear()
+	{
+		while (!frames.empty())
+		{
+			bytes_used -= frames.front().bytes.capacity();
+			spare.push_back(std::move(frames.front()));
+			frames.pop_front();
+		}
+
+		keyframes = 0;
+		encoded.reset();
+		decoded.reset();
+		decoded_frame = SIZE_MAX;
+	}
+
+	bool empty() const { return frames.empty(); }
+	uint64_t oldest_tick() const { return frames.front().tick; }
+	uint64_t newest_tick() const { return frames.back().tick; }
+	size_t memory_used() const { return bytes_used; }
+
+	// Rebuilds the circles as they were at the given (retained) tick. Their positions are quantized,
+	// and they are at rest; they are only meant to be looked at.
+	void seek(const uint64_t tick, circle_store& out)
+	{
+		const size_t target = size_t(tick - oldest_tick());
+
+		// scrubbing forward continues from the last decoded frame; anything else starts from a keyframe
+		size_t next = target;
+		if (decoded_frame == SIZE_MAX || decoded_frame > target || frames[decoded_frame].tick != decoded_tick)
+		{
+			while (!frames[next].keyframe) --next;
+		}
+		else
+		{
+			next = decoded_frame + 1;
+			for (size_t i = next; i <= target; ++i)
+			{
+				if (frames[i].keyframe) next = i;
+			}
+		}
+
+		for (; next <= target; ++next)
+		{
+			if (frames[next].keyframe) decoded.reset();
+			decode(frames[next].bytes, decoded);
+		}
+
+		decoded_frame = target;
+		decoded_tick = tick;
+
+		out.clear();
+		out.grow(decoded.handles.size());
+		for (size_t i = 0; i < decoded.handles.size(); ++i)
+		{
+			const slot_state& state = decoded.slots[decoded.handles[i]];
+			out.set_position(i, quantize.position(state.x, state.y));
+			out.reset_velocity(i);
+			out.radii[i] = state.radius;
+			out.colors[i] = state.color;
+		}
+	}
+
+private:
+	struct frame
+	{
+		uint64_t tick = 0;
+		bool keyframe = false;
+		std::vector<uint8_t> bytes;
+	};
+
+	struct slot_state
+	{
+		uint32_t generation = UINT32_MAX;
+		int32_t x = 0; // quantized
+		int32_t y = 0;
+		float radius = 0.f;
+		sf::Color color;
+	};
+
+	// what a decoder knows after the last frame: the circles in order (as slots), and each slot's state
+	struct stream_state
+	{
+		std::vector<uint32_t> handles;
+		std::vector<slot_state> slots;
+
+		void reset()
+		{
+			handles.clear();
+			slots.clear();
+		}
+	};
+
+	void encode(const circle_store& circles, stream_state& state, std::vector<uint8_t>& out)
+	{
+		out.clear();
+		write_varint(out, (uint32_t)circles.size());
+
+		// the circles changed if any index now refers to a different circle
+		bool changed = state.handles.size() != circles.size();
+		for (size_t i = 0; i < circles.size() && !changed; ++i)
+		{
+			const circle_handle handle = circles.handle_of(i);
+			changed = state.handles[i] != handle.slot || state.slots[handle.slot].generation != handle.generation;
+		}
+
+		out.push_back(uint8_t(changed));
+
+		if (changed)
+		{
+			state.handles.resize(circles.size());
+			uint32_t previous_slot = 0;
+
+			for (size_t i = 0; i < circles.size(); ++i)
+			{
+				const auto [slot, generation] = circles.handle_of(i);
+				if (slot >= state.slots.size()) state.slots.resize(slot + 1);
+
+				slot_state& s = state.slots[slot];
+				const bool is_new = s.generation != generation;
+				write_varint(out, (zigzag_encode(int32_t(slot - previous_slot)) << 1) | (is_new ? 1u : 0u));
+
+				if (is_new)
+				{
+					s = { generation, 0, 0, circles.radii[i], circles.colors[i] };
+					append(out, s.radius);
+					append(out, s.color);
+				}
+
+				state.handles[i] = slot;
+				previous_slot = slot;
+			}
+		}
+
+		uint32_t unmoved = 0;
+		for (size_t i = 0; i < circles.size(); ++i)
+		{
+			slot_state& s = state.slots[state.handles[i]];
+			const int32_t qx = quantize.x(circles.x[i]);
+			const int32_t qy = quantize.y(circles.y[i]);
+
+			if (qx == s.x && qy == s.y)
+			{
+				++unmoved;
+				continue;
+			}
+
+			write_varint(out, unmoved);
+			write_varint(out, zigzag_encode(qx - s.x));
+			write_varint(out, zigzag_encode(qy - s.y));
+			unmoved = 0;
+
+			s.x = qx;
+			s.y = qy;
+		}
+
+		if (unmoved > 0) write_varint(out, unmoved);
+	}
+
+	static void decode(const std::vector<uint8_t>& bytes, stream_state& state)
+	{
+		const uint8_t* in = bytes.data();
+		const uint32_t count = read_varint(in);
+		const bool changed = *in++ != 0;
+
+		if (changed)
+		{
+			state.handles.resize(count);
+			uint32_t slot = 0;
+
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				const uint32_t record = read_varint(in);
+				slot += zigzag_decode(record >> 1);
+				if (slot >= state.slots.size()) state.slots.resize(slot + 1);
+
+				if (record & 1)
+				{
+					slot_state& s = state.slots[slot];
+					s.x = 0;
+					s.y = 0;
+					in = extract(in, s.radius);
+					in = extract(in, s.color);
+				}
+
+				state.handles[i] = slot;
+			}
+		}
+
+		uint32_t i = 0;
+		while (i < count)
+		{
+			i += read_varint(in); // skip the circles that didn't move
+			if (i == count) break;
+
+			slot_state& s = state.slots[state.handles[i]];
+			s.x += zigzag_decode(read_varint(in));
+			s.y += zigzag_decode(read_varint(in));
+			++i;
+		}
+	}
+
+	template<typename T>
+	static void append(std::vector<uint8_t>& out, const T& value)
+	{
+		const size_t at = out.size();
+		out.resize(at + sizeof(T));
+		std::memcpy(out.data() + at, &value, sizeof(T));
+	}
+
+	template<typename T>
+	static const uint8_t* extract(const uint8_t* in, T& value)
+	{
+		std::memcpy(&value, in, sizeof(T));
+		return in + sizeof(T);
+	}
+
+	void drop_oldest_keyframe()
+	{
+		do
+		{
+			bytes_used -= frames.front().bytes.capacity();
+			spare.push_back(std::move(frames.front()));
+			frames.pop_front();
+		} while (!frames.front().keyframe);
+
+		--keyframes;
+
+		// the decoded frame's index has shifted; start over from a keyframe next time
+		decoded_frame = SIZE_MAX;
+	}
+
+	quantizer quantize;
+
+	std::deque<frame> frames;
+	std::vector<frame> spare; // dropped frames, whose memory is reused
+	size_t bytes_used = 0;
+	size_t keyframes = 0;
+
+	stream_state encoded;
+
+	stream_state decoded;
+	size_t decoded_frame = SIZE_MAX;
+	uint64_t decoded_tick = 0;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "detail.hpp"
+
+// PCG32 (see pcg-random.org): 64 bits of state and 32 bits of output per step. Generators
+// seeded with the same seed but different streams produce independent sequences.
+class pcg32
+{
+public:
+	explicit pcg32(const uint64_t seed = detail::random_seed, const uint64_t stream = 0)
+	{
+		set_seed(seed, stream);
+	}
+
+	void set_seed(const uint64_t seed, const uint64_t stream = 0)
+	{
+		state = 0;
+		increment = (stream << 1u) | 1u;
+		next();
+		state += seed;
+		next();
+	}
+
+	uint32_t next()
+	{
+		const uint64_t old_state = state;
+		state = old_state * 6364136223846793005ull + increment;
+
+		const uint32_t xorshifted = uint32_t(((old_state >> 18u) ^ old_state) >> 27u);
+		const uint32_t rotation = uint32_t(old_state >> 59u);
+		return (xorshifted >> rotation) | (xorshifted << ((0u - rotation) & 31u));
+	}
+
+	// An unbiased integer in [0, bound), using Lemire's multiply-and-reject method
+	uint32_t next_below(const uint32_t bound)
+	{
+		uint64_t m = uint64_t(next()) * bound;
+		uint32_t low = uint32_t(m);
+
+		if (low < bound)
+		{
+			const uint32_t threshold = (0u - bound) % bound;
+			while (low < threshold)
+			{
+				m = uint64_t(next()) * bound;
+				low = uint32_t(m);
+			}
+		}
+
+		return uint32_t(m >> 32);
+	}
+
+	// A float in [0, 1), with all 24 bits of precision
+	float next_float()
+	{
+		return (next() >> 8) * (1.f / 16777216.f);
+	}
+
+	uint64_t state;
+	uint64_t increment;
+};
+
+// Each thread gets its own generator, on its own stream, so they never contend or overlap.
+// Anything that must be reproducible should own a pcg32 instead.
+pcg32& thread_rng()
+{
+	static std::atomic<uint64_t> next_stream{ 0 };
+	thread_local pcg32 rng{ detail::random_seed, next_stream++ };
+	return rng;
+}
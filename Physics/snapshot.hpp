@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <SFML/Graphics.hpp>
+
+#include "circle.hpp"
+#include "rng.hpp"
+#include "mapped_file.hpp"
+
+// A barrier, reduced to what is needed to rebuild it
+struct capsule
+{
+	sf::Vector2f a;
+	sf::Vector2f b;
+	float radius;
+};
+
+// Everything needed to restart the simulation from a given tick
+struct world_state
+{
+	uint64_t tick = 0;
+	pcg32 rng;
+	circle_store circles;
+	std::vector<capsule> barriers;
+};
+
+/*
+A snapshot file is a fixed header followed by one array per section, each starting on a 64-byte boundary.
+Arrays are stored exactly as they are laid out in memory (little-endian), so loading a snapshot is one
+copy per array out of the mapped file.
+*/
+namespace snapshot
+{
+	const char magic[8] = { 'P', 'H', 'Y', 'S', 'S', 'N', 'A', 'P' };
+	const uint32_t version = 1;
+	const uint64_t alignment = 64;
+
+	enum section { x, y, previous_x, previous_y, radii, colors, barriers, section_count };
+
+	struct header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t header_size;
+		uint64_t tick;
+		uint64_t rng_state;
+		uint64_t rng_increment;
+		uint64_t circle_count;
+		uint64_t barrier_count;
+		uint64_t offsets[section_count]; // from the start of the file
+	};
+
+	static_assert(sizeof(sf::Color) == 4, "colors are stored as four bytes");
+	static_assert(sizeof(capsule) == 5 * sizeof(float), "capsules are stored as five floats");
+
+	uint64_t section_size(const section s, const uint64_t circle_count, const uint64_t barrier_count)
+	{
+		switch (s)
+		{
+			case colors: return circle_count * sizeof(sf::Color);
+			case barriers: return barrier_count * sizeof(capsule);
+			default: return circle_count * sizeof(float);
+		}
+	}
+
+	uint64_t align(const uint64_t offset)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+}
+
+// With `durable`, the file is flushed all the way to disk before returning
+bool save_snapshot(const world_state& state, const std::string& path, const bool durable = false)
+{
+	using namespace snapshot;
+
+	header h{};
+	std::memcpy(h.magic, snapshot::magic, sizeof(h.magic));
+	h.version = snapshot::version;
+	h.header_size = sizeof(header);
+	h.tick = state.tick;
+	h.rng_state = state.rng.state;
+	h.rng_increment = state.rng.increment;
+	h.circle_count = state.circles.size();
+	h.barrier_count = state.barriers.size();
+
+	uint64_t offset = align(sizeof(header));
+	for (int s = 0; s < section_count; ++s)
+	{
+		h.offsets[s] = offset;
+		offset = align(offset + section_size(section(s), h.circle_count, h.barrier_count));
+	}
+
+	const void* data[section_count] = {
+		state.circles.x.data(), state.circles.y.data(),
+		state.circles.previous_x.data(), state.circles.previous_y.data(),
+		state.circles.radii.data(), state.circles.colors.data(),
+		state.barriers.data() };
+
+	std::FILE* file = std::fopen(path.c_str(), "wb");
+	if (file == nullptr) return false;
+
+	bool ok = std::fwrite(&h, sizeof(h), 1, file) == 1;
+	uint64_t written = sizeof(h);
+
+	const char padding[alignment] = {};
+	for (int s = 0; s < section_count && ok; ++s)
+	{
+		const uint64_t size = section_size(section(s), h.circle_count, h.barrier_count);
+
+		ok = std::fwrite(padding, 1, h.offsets[s] - written, file) == h.offsets[s] - written
+			&& std::fwrite(data[s], 1, size, file) == size;
+		written = h.offsets[s] + size;
+	}
+
+	if (ok && durable)
+	{
+#ifdef _WIN32
+		ok = std::fflush(file) == 0 && _commit(_fileno(file)) == 0;
+#else
+		ok = std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+#endif
+	}
+
+	return std::fclose(file) == 0 && ok;
+}
+
+bool load_snapshot(world_state& state, const std::string& path)
+{
+	using namespace snapshot;
+
+	const mapped_file file{ path };
+	if (!file.is_open() || file.size() < sizeof(header)) return false;
+
+	header h;
+	std::memcpy(&h, file.data(), sizeof(h));
+
+	if (std::memcmp(h.magic, snapshot::magic, sizeof(h.magic)) != 0 ||
+		h.version != snapshot::version ||
+		h.header_size != sizeof(header)) return false;
+
+	// bounded by the file before any size is computed, so that no arithmetic below can overflow
+	if (h.circle_count > file.size() / sizeof(float) || h.barrier_count > file.size() / sizeof(capsule)) return false;
+
+	for (int s = 0; s < section_count; ++s)
+	{
+		if (h.offsets[s] > file.size() ||
+			section_size(section(s), h.circle_count, h.barrier_count) > file.size() - h.offsets[s]) return false;
+	}
+
+	const auto section_data = [&](const section s) { return file.data() + h.offsets[s]; };
+
+	state.tick = h.tick;
+	state.rng.state = h.rng_state;
+	state.rng.increment = h.rng_increment;
+
+	state.circles.clear();
+	state.circles.grow(h.circle_count);
+	std::memcpy(state.circles.x.data(), section_data(x), section_size(x, h.circle_count, 0));
+	std::memcpy(state.circles.y.data(), section_data(y), section_size(y, h.circle_count, 0));
+	std::memcpy(state.circles.previous_x.data(), section_data(previous_x), section_size(previous_x, h.circle_count, 0));
+	std::memcpy(state.circles.previous_y.data(), section_data(previous_y), section_size(previous_y, h.circle_count, 0));
+	std::memcpy(state.circles.radii.data(), section_data(radii), section_size(radii, h.circle_count, 0));
+	std::memcpy(state.circles.colors.data(), section_data(colors), section_size(colors, h.circle_count, 0));
+
+	state.barriers.resize(h.barrier_count);
+	std::memcpy(state.barriers.data(), section_data(barriers), section_size(barriers, 0, h.barrier_count));
+
+	return true;
+}
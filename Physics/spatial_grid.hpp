@@ -0,0 +1,206 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "detail.hpp"
+#include "circle.hpp"
+
+// An unbounded uniform grid, rebuilt at the end of every tick. Cells are as wide as the largest circle, and only
+// occupied cells are stored, in a hash table keyed by cell coordinates, so memory follows the number
+// of circles rather than the size of the world. Each cell holds a singly linked list of circle indices
+// threaded through `next`.
+class spatial_grid
+{
+public:
+	void build(const circle_store& circles)
+	{
+		largest_radius = circles.empty() ? 0.f : *std::max_element(circles.radii.cbegin(), circles.radii.cend());
+		cell_size = std::max(largest_radius * 2.f, 1.f);
+
+		// at most half full, even if every circle has a cell to itself
+		size_t capacity = 16;
+		while (capacity < circles.size() * 2) capacity *= 2;
+		reset_table(capacity);
+
+		next.resize(circles.size());
+
+		// insert back to front, so each cell lists its circles in ascending order
+		for (size_t i = circles.size(); i-- > 0; )
+		{
+			insert(i, circles.position(i), circles.radius(i));
+		}
+	}
+
+	void insert(const size_t index, const sf::Vector2f position, const float radius)
+	{
+		if (index >= next.size()) next.resize(index + 1);
+
+		largest_radius = std::max(largest_radius, radius);
+
+		int& head = head_of(key_of(cell_of(position.x), cell_of(position.y)));
+		next[index] = head;
+		head = (int)index;
+	}
+
+	// Calls f(index) for every circle in the cells touched by the given point and radius.
+	// Circles are not distance-checked; the caller is expected to do that.
+	template<typename F>
+	void for_each_near(const sf::Vector2f point, const float radius, F f) const
+	{
+		const int32_t col_begin = cell_of(point.x - radius);
+		const int32_t col_end = cell_of(point.x + radius);
+		const int32_t row_begin = cell_of(point.y - radius);
+		const int32_t row_end = cell_of(point.y + radius);
+
+		for (int32_t row = row_begin; row <= row_end; ++row)
+		{
+			for (int32_t col = col_begin; col <= col_end; ++col)
+			{
+				for (int i = find(key_of(col, row)); i != -1; i = next[i])
+				{
+					f((size_t)i);
+				}
+			}
+		}
+	}
+
+	// Calls f(index) for every circle whose cell overlaps the given rectangle. A rectangle covering more
+	// cells than are occupied is served by walking the occupied cells instead, so that a view of the
+	// whole world costs no more than a pass over every circle.
+	template<typename F>
+	void for_each_in(const sf::Vector2f min, const sf::Vector2f max, F f) const
+	{
+		const int32_t col_begin = cell_of(min.x);
+		const int32_t col_end = cell_of(max.x);
+		const int32_t row_begin = cell_of(min.y);
+		const int32_t row_end = cell_of(max.y);
+
+		if (double(col_end - col_begin + 1) * double(row_end - row_begin + 1) > double(occupied))
+		{
+			for (size_t slot = 0; slot < keys.size(); ++slot)
+			{
+				if (heads[slot] == -1) continue;
+
+				const int32_t col = int32_t(keys[slot] >> 32);
+				const int32_t row = int32_t(uint32_t(keys[slot]));
+				if (col < col_begin || col > col_end || row < row_begin || row > row_end) continue;
+
+				for (int i = heads[slot]; i != -1; i = next[i])
+				{
+					f((size_t)i);
+				}
+			}
+			return;
+		}
+
+		for (int32_t row = row_begin; row <= row_end; ++row)
+		{
+			for (int32_t col = col_begin; col <= col_end; ++col)
+			{
+				for (int i = find(key_of(col, row)); i != -1; i = next[i])
+				{
+					f((size_t)i);
+				}
+			}
+		}
+	}
+
+	// Returns true if f(index) is true for any circle in the cells touched by the given point and radius
+	template<typename F>
+	bool any_near(const sf::Vector2f point, const float radius, F f) const
+	{
+		const int32_t col_begin = cell_of(point.x - radius);
+		const int32_t col_end = cell_of(point.x + radius);
+		const int32_t row_begin = cell_of(point.y - radius);
+		const int32_t row_end = cell_of(point.y + radius);
+
+		for (int32_t row = row_begin; row <= row_end; ++row)
+		{
+			for (int32_t col = col_begin; col <= col_end; ++col)
+			{
+				for (int i = find(key_of(col, row)); i != -1; i = next[i])
+				{
+					if (f((size_t)i)) return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+	// Queries for circles touching circle i should reach this far past its radius
+	float max_radius() const { return largest_radius; }
+
+	size_t occupied_cells() const { return occupied; }
+
+private:
+	// far enough out that nothing meaningful is lost, near enough that cell coordinates fit
+	int32_t cell_of(const float v) const { return (int32_t)std::floor(std::clamp(v / cell_size, -1e9f, 1e9f)); }
+
+	static uint64_t key_of(const int32_t col, const int32_t row) { return (uint64_t(uint32_t(col)) << 32) | uint32_t(row); }
+
+	size_t slot_of(const uint64_t key) const { return size_t((key * 0x9E3779B97F4A7C15ull) >> shift); }
+
+	// linear probing; a slot is empty while its head is -1
+	int find(const uint64_t key) const
+	{
+		for (size_t slot = slot_of(key); ; slot = (slot + 1) & (keys.size() - 1))
+		{
+			if (heads[slot] == -1) return -1;
+			if (keys[slot] == key) return heads[slot];
+		}
+	}
+
+	int& head_of(const uint64_t key)
+	{
+		if ((occupied + 1) * 2 > keys.size()) grow();
+
+		size_t slot = slot_of(key);
+		for (; heads[slot] != -1; slot = (slot + 1) & (keys.size() - 1))
+		{
+			if (keys[slot] == key) return heads[slot];
+		}
+
+		// heads[slot] stays -1 until the caller links a circle in, which it always does
+		++occupied;
+		keys[slot] = key;
+		return heads[slot];
+	}
+
+	void reset_table(const size_t capacity)
+	{
+		keys.assign(capacity, 0);
+		heads.assign(capacity, -1);
+		occupied = 0;
+
+		shift = 64;
+		for (size_t c = capacity; c > 1; c /= 2) --shift;
+	}
+
+	// only when circles are inserted after build(), by spawning
+	void grow()
+	{
+		const std::vector<uint64_t> old_keys = std::move(keys);
+		const std::vector<int> old_heads = std::move(heads);
+		reset_table(old_keys.size() * 2);
+
+		for (size_t slot = 0; slot < old_keys.size(); ++slot)
+		{
+			if (old_heads[slot] != -1) head_of(old_keys[slot]) = old_heads[slot];
+		}
+	}
+
+	float cell_size = 1.f;
+	float largest_radius = 0.f;
+
+	std::vector<uint64_t> keys{ std::vector<uint64_t>(16, 0) };
+	std::vector<int> heads{ std::vector<int>(16, -1) };
+	size_t occupied = 0;
+	int shift = 60; // 64 - log2(capacity)
+
+	std::vector<int> next;
+};
@@ -0,0 +1,383 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "detail.hpp"
+#include "circle.hpp"
+#include "codec.hpp"
+#include "mapped_file.hpp"
+
+namespace trajectory
+{
+	const char magic[8] = { 'P', 'H', 'Y', 'S', 'T', 'R', 'A', 'J' };
+	const uint32_t version = 2; // version 1 clamped positions to the region; its files read the same way
+	const uint32_t max_slot = 1u << 28; // far more than any circle store hands out; past it, a file is corrupt
+
+	// one circle in one frame, as the file describes it
+	struct record
+	{
+		uint32_t slot;
+		bool is_new;
+		int32_t x; // quantized
+		int32_t y;
+	};
+
+	// One circle's record: its slot as a delta from the previous record's, then its position as a delta
+	// from where its slot was in the previous frame (`last`), or from 0, 0 if it is new
+	void write_record(std::vector<uint8_t>& out, const uint32_t previous_slot, const record& r, const record& last)
+	{
+		write_varint(out, (zigzag_encode(int32_t(r.slot - previous_slot)) << 1) | (r.is_new ? 1u : 0u));
+		write_varint(out, zigzag_encode(r.x - (r.is_new ? 0 : last.x)));
+		write_varint(out, zigzag_encode(r.y - (r.is_new ? 0 : last.y)));
+	}
+
+	// Turns frames' circle records back into slots and positions. Frames must be decoded in order.
+	class decoder
+	{
+	public:
+		// Returns false if the records are malformed
+		bool decode(const uint8_t* in, const uint8_t* const end, const size_t count, std::vector<record>& out)
+		{
+			out.clear();
+			uint32_t slot = 0;
+
+			for (size_t i = 0; i < count; ++i)
+			{
+				uint32_t head, dx, dy;
+				if (!read_varint(in, end, head) || !read_varint(in, end, dx) || !read_varint(in, end, dy)) return false;
+
+				slot += (uint32_t)zigzag_decode(head >> 1);
+				if (slot >= max_slot) return false;
+				if (slot >= last.size()) last.resize(slot + 1);
+
+				record& r = last[slot];
+				if (head & 1) r.x = r.y = 0;
+				r.slot = slot;
+				r.is_new = head & 1;
+				// wrapping, rather than overflowing, on corrupt input
+				r.x = int32_t(uint32_t(r.x) + uint32_t(zigzag_decode(dx)));
+				r.y = int32_t(uint32_t(r.y) + uint32_t(zigzag_decode(dy)));
+				out.push_back(r);
+			}
+
+			return in == end;
+		}
+
+	private:
+		std::vector<record> last; // per slot, as of the last frame
+	};
+}
+
+// Reads a file written by trajectory_exporter, one frame at a time
+class trajectory_reader
+{
+public:
+	explicit trajectory_reader(const std::string& path) : file(path)
+	{
+		float bounds[4];
+		const size_t header_size = sizeof(trajectory::magic) + sizeof(uint32_t) + sizeof(bounds);
+		if (!file.is_open() || file.size() < header_size) return;
+
+		uint32_t version;
+		std::memcpy(&version, file.data() + sizeof(trajectory::magic), sizeof(version));
+		std::memcpy(bounds, file.data() + sizeof(trajectory::magic) + sizeof(version), sizeof(bounds));
+		if (std::memcmp(file.data(), trajectory::magic, sizeof(trajectory::magic)) != 0 || (version != 1 && version != trajectory::version)) return;
+
+		quantize = quantizer{ { bounds[0], bounds[1], bounds[2], bounds[3] } };
+		in = file.data() + header_size;
+		valid = true;
+	}
+
+	bool is_valid() const { return valid; }
+	bool at_end() const { return valid && in == file.data() + file.size(); }
+	const quantizer& get_quantizer() const { return quantize; }
+
+	// Returns false at the end of the file, or if the file is corrupt (then is_valid() is false too)
+	bool next(uint64_t& tick, std::vector<trajectory::record>& records)
+	{
+		if (!valid || at_end()) return false;
+
+		const uint8_t* const end = file.data() + file.size();
+		uint32_t frame_tick, count, byte_count;
+		valid = read_varint(in, end, frame_tick) && read_varint(in, end, count) && read_varint(in, end, byte_count)
+			&& byte_count <= size_t(end - in) && decoding.decode(in, in + byte_count, count, records);
+		if (!valid) return false;
+
+		tick = frame_tick;
+		frame_bytes = in;
+		frame_size = byte_count;
+		in += byte_count;
+		return true;
+	}
+
+	// the encoded records of the frame last returned by next()
+	const uint8_t* get_frame_bytes() const { return frame_bytes; }
+	size_t get_frame_size() const { return frame_size; }
+
+private:
+	mapped_file file;
+	const uint8_t* in = nullptr;
+	const uint8_t* frame_bytes = nullptr;
+	size_t frame_size = 0;
+	bool valid = false;
+	quantizer quantize{ { 0.f, 0.f, 1.f, 1.f } };
+	trajectory::decoder decoding;
+};
+
+// Decodes a whole file, and encodes every frame again to check that it comes out byte for byte the same.
+// Returns false if the file is corrupt or any frame does not round-trip.
+bool verify_trajectories(const std::string& path, size_t& frames, size_t& records)
+{
+	trajectory_reader reader{ path };
+	frames = 0;
+	records = 0;
+
+	uint64_t tick;
+	std::vector<trajectory::record> frame;
+	std::vector<trajectory::record> last; // per slot
+	std::vector<uint8_t> encoded;
+
+	while (reader.next(tick, frame))
+	{
+		encoded.clear();
+		uint32_t previous_slot = 0;
+		for (const auto& r : frame)
+		{
+			if (r.slot >= last.size()) last.resize(r.slot + 1);
+			trajectory::write_record(encoded, previous_slot, r, last[r.slot]);
+			last[r.slot] = r;
+			previous_slot = r.slot;
+		}
+
+		if (encoded.size() != reader.get_frame_size() ||
+			!std::equal(encoded.cbegin(), encoded.cend(), reader.get_frame_bytes())) return false;
+
+		++frames;
+		records += frame.size();
+	}
+
+	return reader.at_end();
+}
+
+/*
+Writes every circle's position, every tick, to a file. The tick thread only copies positions into a
+spare buffer; quantizing, encoding, and writing happen on a background thread. If the writer falls
+too far behind, frames are dropped (and counted) rather than stalling the simulation.
+
+File layout: a header (magic, version, quantization region), then one frame per tick:
+	varint tick, varint circle count, varint byte count of the circle records, then per circle:
+	varint (zigzag(slot - previous slot) << 1 | is_new), varint zigzag(dx), varint zigzag(dy)
+where dx and dy are quantized deltas against the same circle's position in the previous frame
+(or against 0, 0 if the circle is new). Circles outside the region keep their precision; their
+coordinates are past the 16-bit range, and they take a few more bytes. trajectory_reader reads it back, and verify_trajectories checks
+that a file round-trips.
+*/
+class trajectory_exporter
+{
+public:
+	~trajectory_exporter() { stop(); }
+
+	bool start(const std::string& path, const sf::FloatRect region)
+	{
+		stop();
+
+		file = std::fopen(path.c_str(), "wb");
+		if (file == nullptr) return false;
+
+		const float bounds[4] = { region.left, region.top, region.width, region.height };
+		if (std::fwrite(trajectory::magic, sizeof(trajectory::magic), 1, file) != 1 ||
+			std::fwrite(&trajectory::version, sizeof(trajectory::version), 1, file) != 1 ||
+			std::fwrite(bounds, sizeof(bounds), 1, file) != 1)
+		{
+			std::fclose(file);
+			file = nullptr;
+			return false;
+		}
+
+		quantize = quantizer{ region };
+		previous.clear();
+		restart_pending = false;
+		frames_written = 0;
+		frames_dropped = 0;
+		bytes_written = 0;
+		write_failed = false;
+
+		stopping = false;
+		writer = std::thread{ [this] { write_frames(); } };
+		return true;
+	}
+
+	void stop()
+	{
+		if (!writer.joinable()) return;
+
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			stopping = true;
+		}
+		wake.notify_one();
+		writer.join();
+
+		if (std::fclose(file) != 0) write_failed = true;
+		file = nullptr;
+	}
+
+	bool is_running() const { return writer.joinable(); }
+
+	// Call when the circles are replaced wholesale, such as by loading a snapshot. Slots and generations
+	// start over then, so the next frame marks every circle as new instead of continuing a trajectory.
+	void restart()
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		restart_pending = true;
+	}
+
+	// Call once per tick. Costs one copy of the position arrays.
+	void capture(const uint64_t tick, const circle_store& circles)
+	{
+		if (!is_running()) return;
+
+		frame f;
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+
+			if (queued.size() >= detail::export_queue_length)
+			{
+				++frames_dropped;
+				return;
+			}
+
+			// reuse a spent frame's memory when there is one
+			if (!spare.empty())
+			{
+				f = std::move(spare.back());
+				spare.pop_back();
+			}
+
+			f.restart = restart_pending;
+			restart_pending = false;
+		}
+
+		f.tick = tick;
+		f.x.assign(circles.x.cbegin(), circles.x.cend());
+		f.y.assign(circles.y.cbegin(), circles.y.cend());
+		f.handles.resize(circles.size());
+		for (size_t i = 0; i < circles.size(); ++i)
+		{
+			f.handles[i] = circles.handle_of(i);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			queued.push_back(std::move(f));
+		}
+		wake.notify_one();
+	}
+
+	std::atomic<size_t> frames_written{ 0 };
+	std::atomic<size_t> frames_dropped{ 0 };
+	std::atomic<size_t> bytes_written{ 0 };
+	std::atomic<bool> write_failed{ false }; // nothing more is written after a failed write
+
+private:
+	struct frame
+	{
+		uint64_t tick = 0;
+		bool restart = false;
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<circle_handle> handles;
+	};
+
+	// what the decoder will know about each slot, as of the last frame
+	struct slot_state
+	{
+		uint32_t generation = UINT32_MAX;
+		trajectory::record last{ 0, false, 0, 0 };
+	};
+
+	void write_frames()
+	{
+		std::vector<uint8_t> records;
+		std::vector<uint8_t> prefix;
+
+		while (true)
+		{
+			frame f;
+			{
+				std::unique_lock<std::mutex> lock{ mutex };
+				wake.wait(lock, [&] { return stopping || !queued.empty(); });
+
+				if (queued.empty()) return; // stopping, and everything has been written
+
+				f = std::move(queued.front());
+				queued.pop_front();
+			}
+
+			if (f.restart) previous.clear();
+			encode(f, records);
+
+			prefix.clear();
+			write_varint(prefix, (uint32_t)f.tick);
+			write_varint(prefix, (uint32_t)f.x.size());
+			write_varint(prefix, (uint32_t)records.size());
+
+			if (!write_failed)
+			{
+				write_failed = std::fwrite(prefix.data(), 1, prefix.size(), file) != prefix.size()
+					|| std::fwrite(records.data(), 1, records.size(), file) != records.size();
+			}
+
+			if (!write_failed)
+			{
+				++frames_written;
+				bytes_written += prefix.size() + records.size();
+			}
+
+			{
+				std::lock_guard<std::mutex> lock{ mutex };
+				spare.push_back(std::move(f));
+			}
+		}
+	}
+
+	void encode(const frame& f, std::vector<uint8_t>& out)
+	{
+		out.clear();
+		uint32_t previous_slot = 0;
+
+		for (size_t i = 0; i < f.handles.size(); ++i)
+		{
+			const auto [slot, generation] = f.handles[i];
+			if (slot >= previous.size()) previous.resize(slot + 1);
+
+			slot_state& state = previous[slot];
+			const trajectory::record r{ slot, state.generation != generation, quantize.x(f.x[i]), quantize.y(f.y[i]) };
+
+			trajectory::write_record(out, previous_slot, r, state.last);
+			state = { generation, r };
+			previous_slot = slot;
+		}
+	}
+
+	std::FILE* file = nullptr;
+	quantizer quantize{ { 0.f, 0.f, 1.f, 1.f } };
+	std::vector<slot_state> previous; // only touched by the writer thread
+
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+	bool restart_pending = false;
+	std::deque<frame> queued;
+	std::vector<frame> spare;
+};
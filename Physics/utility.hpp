@@ -2,12 +2,17 @@
 
 #include <vector>
 #include <chrono>
+#include <algorithm>
+#include <execution>
+#include <numeric>
 
 #include <SFML/Graphics.hpp>
 #include <SFML/Graphics/Text.hpp>
 #include <SFML/Graphics/Font.hpp>
 #include <SFML/Graphics/RenderWindow.hpp>
 
+#include "rng.hpp"
+
 float distance_between(const float x1, const float y1, const float x2, const float y2)
 {
 	const float x_diff = x1 - x2;
@@ -20,14 +25,24 @@ float distance_between(const sf::Vector2f point_a, const sf::Vector2f point_b)
 	return distance_between(point_a.x, point_a.y, point_b.x, point_b.y);
 }
 
+size_t random_int_from(pcg32& rng, const size_t min, const size_t max)
+{
+	return min + rng.next_below(uint32_t(max - min + 1));
+}
+
+float random_float_from(pcg32& rng, const float min, const float max)
+{
+	return (rng.next_float() * (max - min)) + min;
+}
+
 size_t random_int_from(const size_t min, const size_t max)
 {
-	return min + (rand() % (max - min + 1));
+	return random_int_from(thread_rng(), min, max);
 }
 
 float random_float_from(const float min, const float max)
 {
-	return (((float)rand() / RAND_MAX) * (max - min)) + min;
+	return random_float_from(thread_rng(), min, max);
 }
 
 template<class C, class T>
@@ -37,6 +52,54 @@ auto contains(const C& v, const T& x)
 	return end(v) != std::find(begin(v), end(v), x);
 }
 
+// Calls f(chunk, begin, end) for each fixed-size chunk of [0, count), in parallel. The split
+// does not depend on the number of threads, so neither does anything accumulated per chunk.
+template<typename F>
+void parallel_for_chunks(const size_t count, const size_t chunk_size, F f)
+{
+	const size_t chunk_count = (count + chunk_size - 1) / chunk_size;
+
+	if (chunk_count <= 1)
+	{
+		f(size_t(0), size_t(0), count);
+		return;
+	}
+
+	std::vector<size_t> chunks(chunk_count);
+	std::iota(chunks.begin(), chunks.end(), size_t(0));
+
+	std::for_each(std::execution::par, chunks.cbegin(), chunks.cend(), [&](const size_t chunk)
+	{
+		f(chunk, chunk * chunk_size, std::min(count, (chunk + 1) * chunk_size));
+	});
+}
+
+// Calls f(i) for each i in [0, count), in parallel.
+template<typename F>
+void parallel_for(const size_t count, F f, const size_t chunk_size = 1024)
+{
+	parallel_for_chunks(count, chunk_size, [&](const size_t, const size_t begin, const size_t end)
+	{
+		for (size_t i = begin; i < end; ++i) f(i);
+	});
+}
+
+// Calls f(i) for each i in [0, count), in parallel, and returns the largest result (or 0).
+template<typename F>
+float parallel_max(const size_t count, F f, const size_t chunk_size = 1024)
+{
+	std::vector<float> chunk_max((count + chunk_size - 1) / chunk_size + 1, 0.f);
+
+	parallel_for_chunks(count, chunk_size, [&](const size_t chunk, const size_t begin, const size_t end)
+	{
+		float max = 0.f;
+		for (size_t i = begin; i < end; ++i) max = std::max(max, f(i));
+		chunk_max[chunk] = max;
+	});
+
+	return *std::max_element(chunk_max.cbegin(), chunk_max.cend());
+}
+
 auto current_time_in_ms()
 {
 	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
@@ -60,23 +123,6 @@ bool is_point_in_triangle(sf::Vector2f pt, sf::Vector2f v1, sf::Vector2f v2, sf:
 	return (b1 == b2) && (b2 == b3);
 }
 
-bool is_point_in_rectangle(sf::Vector2f p, const sf::RectangleShape rect)
-{
-	float w = rect.getSize().x;
-	float h = rect.getSize().y;
-
-	// A B
-	// C D
-	sf::Vector2f a = rect.getTransform().transformPoint(0.f, 0.f);
-	sf::Vector2f b = rect.getTransform().transformPoint(w, 0.f);
-	sf::Vector2f c = rect.getTransform().transformPoint(0.f, h);
-	sf::Vector2f d = rect.getTransform().transformPoint(w, h);
-
-	return
-		is_point_in_triangle(p, a, b, c) ||
-		is_point_in_triangle(p, b, c, d);
-}
-
 sf::Vector2f get_closest_point(sf::Vector2f a, sf::Vector2f b, sf::Vector2f p)
 {
 	auto ab = b - a;
@@ -91,6 +137,80 @@ sf::Vector2f get_closest_point(sf::Vector2f a, sf::Vector2f b, sf::Vector2f p)
 
 }
 
+float dot(const sf::Vector2f a, const sf::Vector2f b)
+{
+	return a.x * b.x + a.y * b.y;
+}
+
+// Finds the earliest t in [0, 1] where a ray from p along d enters a circle. Returns false if it doesn't,
+// or if p already starts inside the circle.
+bool sweep_point_against_circle(const sf::Vector2f p, const sf::Vector2f d, const sf::Vector2f center, const float radius, float& t)
+{
+	const sf::Vector2f m = p - center;
+	const float a = dot(d, d);
+	const float b = dot(m, d);
+	const float c = dot(m, m) - radius * radius;
+
+	if (c < 0.f || b > 0.f || a == 0.f) return false; // inside, or moving away
+
+	const float discriminant = b * b - a * c;
+	if (discriminant < 0.f) return false;
+
+	t = (-b - sqrt(discriminant)) / a;
+	return t <= 1.f;
+}
+
+// Finds the earliest t in [0, 1] where a ray from p along d enters the capsule around segment a-b.
+// A ray that starts inside the capsule (a circle resting on a barrier overlaps it a little) hits at
+// t = 0 if it heads further in, and misses if it heads out.
+bool sweep_point_against_capsule(const sf::Vector2f p, const sf::Vector2f d,
+	const sf::Vector2f a, const sf::Vector2f b, const float radius, float& t)
+{
+	const sf::Vector2f ab = b - a;
+	const float length = sqrt(dot(ab, ab));
+
+	const sf::Vector2f closest = (length > 0.f) ? get_closest_point(a, b, p) : a;
+	const float distance = distance_between(p, closest);
+	if (distance < radius)
+	{
+		// exactly on the segment there is no outward direction to push along
+		t = 0.f;
+		return distance > 0.f && dot(d, p - closest) < 0.f;
+	}
+
+	bool hit = false;
+	t = 2.f;
+
+	if (length > 0.f)
+	{
+		// the two long sides
+		const sf::Vector2f u = ab / length;
+		const sf::Vector2f n{ -u.y, u.x };
+
+		const float side = dot(p - a, n);
+		const float speed = dot(d, n);
+
+		if (std::abs(side) > radius && side * speed < 0.f)
+		{
+			const float side_t = ((side > 0.f ? radius : -radius) - side) / speed;
+			const float along = dot(p + d * side_t - a, u);
+
+			if (side_t <= 1.f && along >= 0.f && along <= length)
+			{
+				t = side_t;
+				hit = true;
+			}
+		}
+	}
+
+	// the rounded ends
+	float end_t;
+	if (sweep_point_against_circle(p, d, a, radius, end_t) && end_t < t) { t = end_t; hit = true; }
+	if (sweep_point_against_circle(p, d, b, radius, end_t) && end_t < t) { t = end_t; hit = true; }
+
+	return hit;
+}
+
 void draw_line(sf::RenderWindow& window, sf::Vector2f a, sf::Vector2f b,
 	const float width = 2.f, const sf::Color color = sf::Color::Red)
 {
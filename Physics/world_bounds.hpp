@@ -0,0 +1,244 @@
+#pragma once
+
+#include <vector>
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#include <SFML/Graphics.hpp>
+
+#include "detail.hpp"
+#include "utility.hpp"
+#include "circle.hpp"
+#include "grid_sampler.hpp"
+
+enum class bounds_shape
+{
+	none,
+	box,
+	circle,
+	sampled // any shape, given as a signed distance sampled on a grid
+};
+
+// Keeps every circle inside a shape by moving any circle that pokes out straight back in.
+// One pass over the position arrays, four circles at a time.
+class world_bounds
+{
+public:
+	static world_bounds box(const sf::FloatRect rect)
+	{
+		world_bounds bounds;
+		bounds.shape = bounds_shape::box;
+		bounds.rect = rect;
+		return bounds;
+	}
+
+	static world_bounds circle(const sf::Vector2f center, const float radius)
+	{
+		world_bounds bounds;
+		bounds.shape = bounds_shape::circle;
+		bounds.center = center;
+		bounds.radius = radius;
+		return bounds;
+	}
+
+	// signed_distance(point) is negative inside the shape. It is sampled once, over the region.
+	template<typename F>
+	static world_bounds sampled(const sf::FloatRect region, const size_t cols, const size_t rows, F signed_distance)
+	{
+		world_bounds bounds;
+		bounds.shape = bounds_shape::sampled;
+		bounds.grid = grid_sampler{ region, cols, rows };
+		bounds.distance.resize(bounds.grid.node_count());
+		bounds.normal_x.resize(bounds.grid.node_count());
+		bounds.normal_y.resize(bounds.grid.node_count());
+
+		for (size_t row = 0; row < bounds.grid.get_rows(); ++row)
+		{
+			for (size_t col = 0; col < bounds.grid.get_cols(); ++col)
+			{
+				const sf::Vector2f p = bounds.grid.node_position(col, row);
+				const size_t node = row * bounds.grid.get_cols() + col;
+
+				// the outward normal is the direction the distance grows fastest
+				const float e = 1.f;
+				const sf::Vector2f gradient{
+					signed_distance(p + sf::Vector2f{ e, 0.f }) - signed_distance(p - sf::Vector2f{ e, 0.f }),
+					signed_distance(p + sf::Vector2f{ 0.f, e }) - signed_distance(p - sf::Vector2f{ 0.f, e }) };
+				const float length = std::max(sqrt(dot(gradient, gradient)), 1e-6f);
+
+				bounds.distance[node] = signed_distance(p);
+				bounds.normal_x[node] = gradient.x / length;
+				bounds.normal_y[node] = gradient.y / length;
+			}
+		}
+
+		return bounds;
+	}
+
+	// two round chambers, one above the other, joined by a narrow neck
+	static world_bounds hourglass(const sf::FloatRect region)
+	{
+		const float chamber_radius = region.height * .26f;
+		const sf::Vector2f top{ region.left + region.width / 2.f, region.top + region.height * .28f };
+		const sf::Vector2f bottom{ top.x, region.top + region.height * .72f };
+		const sf::Vector2f neck_half_size{ detail::circle_radius_max * 2.f, region.height * .25f };
+
+		const auto signed_distance = [=](const sf::Vector2f p)
+		{
+			const float to_top = distance_between(p, top) - chamber_radius;
+			const float to_bottom = distance_between(p, bottom) - chamber_radius;
+
+			const sf::Vector2f q{ std::abs(p.x - top.x) - neck_half_size.x, std::abs(p.y - (top.y + bottom.y) / 2.f) - neck_half_size.y };
+			const sf::Vector2f outside{ std::max(q.x, 0.f), std::max(q.y, 0.f) };
+			const float to_neck = sqrt(dot(outside, outside)) + std::min(std::max(q.x, q.y), 0.f);
+
+			return std::min({ to_top, to_bottom, to_neck });
+		};
+
+		// sampled a little past the shape, so that circles outside it are still pushed the right way
+		const float margin = detail::circle_radius_max * 4.f;
+		const sf::FloatRect sampled_region{ region.left - margin, region.top - margin, region.width + 2.f * margin, region.height + 2.f * margin };
+		return sampled(sampled_region, detail::bounds_grid_cols, detail::bounds_grid_rows, signed_distance);
+	}
+
+	bounds_shape get_shape() const { return shape; }
+
+	void apply(circle_store& circles) const
+	{
+		if (shape == bounds_shape::none) return;
+
+		parallel_for_chunks(circles.size(), 4096, [&](const size_t, const size_t begin, const size_t end)
+		{
+			switch (shape)
+			{
+				case bounds_shape::box: apply_box(circles, begin, end); break;
+				case bounds_shape::circle: apply_circle(circles, begin, end); break;
+				case bounds_shape::sampled: apply_sampled(circles, begin, end); break;
+				default: break;
+			}
+		});
+	}
+
+private:
+	void apply_box(circle_store& circles, const size_t begin, const size_t end) const
+	{
+		float* const px = circles.x.data();
+		float* const py = circles.y.data();
+		const float* const pr = circles.radii.data();
+
+		const __m128 left = _mm_set1_ps(rect.left);
+		const __m128 top = _mm_set1_ps(rect.top);
+		const __m128 right = _mm_set1_ps(rect.left + rect.width);
+		const __m128 bottom = _mm_set1_ps(rect.top + rect.height);
+
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			const __m128 r = _mm_loadu_ps(pr + i);
+			_mm_storeu_ps(px + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(px + i), _mm_add_ps(left, r)), _mm_sub_ps(right, r)));
+			_mm_storeu_ps(py + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(py + i), _mm_add_ps(top, r)), _mm_sub_ps(bottom, r)));
+		}
+
+		// the remaining zero to three circles
+		for (; i < end; ++i)
+		{
+			px[i] = std::min(std::max(px[i], rect.left + pr[i]), rect.left + rect.width - pr[i]);
+			py[i] = std::min(std::max(py[i], rect.top + pr[i]), rect.top + rect.height - pr[i]);
+		}
+	}
+
+	void apply_circle(circle_store& circles, const size_t begin, const size_t end) const
+	{
+		float* const px = circles.x.data();
+		float* const py = circles.y.data();
+		const float* const pr = circles.radii.data();
+
+		const __m128 center_x = _mm_set1_ps(center.x);
+		const __m128 center_y = _mm_set1_ps(center.y);
+		const __m128 radius_4 = _mm_set1_ps(radius);
+		const __m128 tiny = _mm_set1_ps(1e-6f);
+
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			const __m128 dx = _mm_sub_ps(_mm_loadu_ps(px + i), center_x);
+			const __m128 dy = _mm_sub_ps(_mm_loadu_ps(py + i), center_y);
+			const __m128 distance = _mm_max_ps(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy))), tiny);
+			const __m128 limit = _mm_sub_ps(radius_4, _mm_loadu_ps(pr + i));
+
+			// only the circles past the limit move, back onto it
+			const __m128 outside = _mm_cmpgt_ps(distance, limit);
+			const __m128 scale = _mm_div_ps(limit, distance);
+			const __m128 x = _mm_add_ps(center_x, _mm_mul_ps(dx, scale));
+			const __m128 y = _mm_add_ps(center_y, _mm_mul_ps(dy, scale));
+
+			_mm_storeu_ps(px + i, _mm_or_ps(_mm_and_ps(outside, x), _mm_andnot_ps(outside, _mm_loadu_ps(px + i))));
+			_mm_storeu_ps(py + i, _mm_or_ps(_mm_and_ps(outside, y), _mm_andnot_ps(outside, _mm_loadu_ps(py + i))));
+		}
+
+		// the remaining zero to three circles
+		for (; i < end; ++i)
+		{
+			const float dx = px[i] - center.x;
+			const float dy = py[i] - center.y;
+			const float distance = std::max(sqrt(dx * dx + dy * dy), 1e-6f);
+			const float limit = radius - pr[i];
+
+			if (distance > limit)
+			{
+				px[i] = center.x + dx * (limit / distance);
+				py[i] = center.y + dy * (limit / distance);
+			}
+		}
+	}
+
+	void apply_sampled(circle_store& circles, const size_t begin, const size_t end) const
+	{
+		float* const px = circles.x.data();
+		float* const py = circles.y.data();
+		const float* const pr = circles.radii.data();
+		const __m128 zero = _mm_setzero_ps();
+
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			const __m128 x = _mm_loadu_ps(px + i);
+			const __m128 y = _mm_loadu_ps(py + i);
+
+			size_t node[4];
+			__m128 tx, ty;
+			grid.locate(x, y, node, tx, ty);
+
+			// how far each circle's edge is past the boundary, or 0 if it isn't
+			const __m128 overshoot = _mm_max_ps(_mm_add_ps(grid.sample(distance.data(), node, tx, ty), _mm_loadu_ps(pr + i)), zero);
+
+			_mm_storeu_ps(px + i, _mm_sub_ps(x, _mm_mul_ps(grid.sample(normal_x.data(), node, tx, ty), overshoot)));
+			_mm_storeu_ps(py + i, _mm_sub_ps(y, _mm_mul_ps(grid.sample(normal_y.data(), node, tx, ty), overshoot)));
+		}
+
+		// the remaining zero to three circles
+		for (; i < end; ++i)
+		{
+			size_t node;
+			float tx, ty;
+			grid.locate(px[i], py[i], node, tx, ty);
+
+			const float overshoot = std::max(grid.sample(distance.data(), node, tx, ty) + pr[i], 0.f);
+			px[i] -= grid.sample(normal_x.data(), node, tx, ty) * overshoot;
+			py[i] -= grid.sample(normal_y.data(), node, tx, ty) * overshoot;
+		}
+	}
+
+	bounds_shape shape = bounds_shape::none;
+
+	sf::FloatRect rect; // box
+
+	sf::Vector2f center; // circle
+	float radius = 0.f;
+
+	grid_sampler grid; // sampled
+	std::vector<float> distance;
+	std::vector<float> normal_x;
+	std::vector<float> normal_y;
+};